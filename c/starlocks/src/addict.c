@@ -1,12 +1,15 @@
 /* 
  * Addict - Hapless victim of the Corporate Caffeine Delivery System.
  *
- * Each customer thread has exactly one corresponding addict struct.
- * This struct shall be used for control flow of the thread, and is
- * passed as an argument to the thread when it starts.
+ * Each customer has exactly one corresponding addict struct. This
+ * struct shall be used for control flow of the customer through the
+ * stages of the store (see pipeline.h), and is passed either to the
+ * customer's own thread when it starts, to a pooled worker thread or
+ * to a fiber.
  *
- * It is the thread's responsibility to deallocate its corresponding
- * addict struct before it exits- this is handled in get_coffee().
+ * Addicts come from the day's addict pool. Whichever thread serves
+ * the addict is responsible for giving its struct back once it is
+ * done- this is handled in get_coffee().
  *
  * James Sullivan <sullivan.james.f@gmail.com>
  * 10095183
@@ -17,117 +20,138 @@
 #include "server.h"
 #include "queue.h"
 #include "check.h"
-#include "starlocks.h"
+#include "day.h"
 #include "timer.h"
-#include <semaphore.h>
-#include <sys/time.h>
-
-#ifndef CHAOS
-#include "fifo_mutex.h"
-#endif
+#include "fiber.h"
+#include "hist.h"
+#include "pipeline.h"
 
 /*
- * Initialize an addict with the given parameters, and return a
- * reference to it. Returns NULL on failure.
+ * Initialize a customer of the day with an order of the given type, who
+ * enters the store at stage entry and picks their way on from there
+ * with seed. Returns a reference to it, or NULL on failure.
  */
-struct addict *init_addict(unsigned int time, unsigned int cost,
-        struct server *server, struct server *next)
+struct addict *init_addict(struct day *day, int type,
+        struct stage *entry, unsigned int seed)
 {
-    struct addict *addict = malloc(sizeof(struct addict));
+    struct addict *addict = pool_alloc(&day->addicts);
     check(!addict, out);
 
-    addict->order_time  = time;
-    addict->order_cost  = cost;
+    addict->day         = day;
+    addict->type        = type;
+    if(type == ATYPE_SIMPLE) {
+        addict->order_time = ATIME_SIMPLE;
+        addict->order_cost = ACOST_SIMPLE;
+    } else {
+        addict->order_time = ATIME_COMPLEX;
+        addict->order_cost = ACOST_COMPLEX;
+    }
     addict->caffeinated = 0;
-    addict->server      = server;
-    addict->next        = next;
+    addict->due         = 0;
+    addict->stage       = entry;
+    addict->seed        = seed;
 out:
     return addict;
 }
 
+/* Read the clock that the calling customer is timed by. */
+static stamp_t addict_clock(void)
+{
+    if(fiber_self())
+        return fiber_clock();
+    return timer_now();
+}
+
 /* 
  * Do the gruelling work of getting a coffee. 
  *
- * The thread will attempt to occupy both its first and next service 
- * points in order. While in each critical section, a busy loop is used
- * to simulate the order waiting time.
+ * The thread will walk the store from its entry stage, occupying a
+ * service point at each stage in order. While in each critical section,
+ * a busy loop is used to simulate the order waiting time.
  *
  * After the thread is done, it is their job to deallocate their control
  * struct.
  */
 void get_coffee(struct addict *addict)
 {
-    long time;
-    check(!addict, exit);
-
-    /* 
-     * This is used for two reasons.
-     * 1) With FIFO enabled, this lock maintains the order of the
-     *  threads and atomicizes the operation of selecting a service
-     *  point.
-     * 2) Without FIFO enabled, this lock atomicizes the operation
-     *  of selecting a service point (and also incurs a similar penalty
-     *  of performance to the FIFO lock, keeping things fairish).
-     */
-    #ifndef CHAOS
-    fifo_mutex_lock(&addict->server->lock);
-    sem_wait(&addict->server->service_sem);
-    fifo_mutex_unlock(&addict->server->lock);
-    #else
-    pthread_mutex_lock(&addict->server->lock);
-    sem_wait(&addict->server->service_sem);
-    pthread_mutex_unlock(&addict->server->lock);
-    #endif
+    struct stage *stage = addict->stage;
 
-    serve(addict);
-    /* If there's no next server, also pay */
-    if(!addict->next)
-        pay(addict);
+    /* Simulated customers are all spawned at once; wait to walk in */
+    if(fiber_self() && addict->due > fiber_now())
+        fiber_sleep(addict->due - fiber_now());
 
-    sem_post(&addict->server->service_sem);
+    addict->arrived = addict_clock();
+    while(stage) {
+        stage = stage_dispatch(stage, addict);
+        addict->stage = stage;
+        server_enter(stage->server, addict);
+        serve(addict);
+        /* Stamped before the point is handed on, so service fits in it */
+        addict->end = addict_clock();
+        server_leave(stage->server);
+        server_record(stage->server, addict);
 
-    /* Optional second cashier */
-    if(addict->next) {
-        #ifndef CHAOS
-        fifo_mutex_lock(&addict->next->lock);
-        sem_wait(&addict->next->service_sem);
-        fifo_mutex_unlock(&addict->next->lock);
-        #else
-        pthread_mutex_lock(&addict->next->lock);
-        sem_wait(&addict->next->service_sem);
-        pthread_mutex_unlock(&addict->next->lock);
-        #endif
-
-        pay(addict);
-
-        sem_post(&addict->next->service_sem);
+        /* Arrive at the next stage as we leave this one */
+        stage = stage_next(stage, addict);
+        addict->arrived = addict->end;
     }
 
-exit:
-    /* End the timer, and set our results in the relevant table */
-    gettimeofday(&addict->end, NULL);
-    time = timer_us(&addict->start, &addict->end);
-    switch(addict->order_cost) {
-        case ACOST_SIMPLE:
-            pthread_mutex_lock(&simple_count.count_mutex);
-            simple_times[simple_count.val++] = time;
-            pthread_mutex_unlock(&simple_count.count_mutex);
+    /* The timer ended when we left the last server */
+    addict_done(addict);
+}
+
+/*
+ * Set the finished addict's turnaround time in their day's list of times,
+ *  deallocate it and signal that the customer has left. The addict's
+ *  end time must already be set.
+ *
+ * Each customer claims a slot with a single atomic increment, simple
+ *  customers counting up from the front of the list and complex ones
+ *  down from the back, so recording takes no lock. The turnaround goes
+ *  into the histogram shard of our CPU.
+ */
+void addict_done(struct addict *addict)
+{
+    struct day *day = addict->day;
+    struct day_shard *shard = day_shard_mine(day);
+    int slot;
+    long time = timer_ns(addict->start, addict->end);
+    switch(addict->type) {
+        case ATYPE_SIMPLE:
+            slot = __atomic_fetch_add(&day->simple_count.val, 1,
+                    __ATOMIC_RELAXED);
+            day->times[slot] = time;
+            hist_record(&shard->simple_hist, time);
             break;
-        case ACOST_COMPLEX:
-            pthread_mutex_lock(&complex_count.count_mutex);
-            complex_times[complex_count.val++] = time;
-            pthread_mutex_unlock(&complex_count.count_mutex);
+        case ATYPE_COMPLEX:
+            slot = __atomic_fetch_add(&day->complex_count.val, 1,
+                    __ATOMIC_RELAXED);
+            day->times[day->size - 1 - slot] = time;
+            hist_record(&shard->complex_hist, time);
         default:
             break;
     }
-    free(addict);
-    /* Signal that a thread is exiting */
-    count_dec(running_threads, 1);
-    /* The last one out wakes up main */
-    pthread_mutex_lock(&running_threads.count_mutex);
-    if(running_threads.val == 0)
-        pthread_cond_broadcast(&running_threads.cond);
-    pthread_mutex_unlock(&running_threads.count_mutex);
-    pthread_exit(NULL);
+    pool_free(&day->addicts, addict);
+    /* Signal that a customer is leaving; the last one out wakes main */
+    latch_done(&day->running, 1);
+}
+
+/*
+ * Deallocate an addict that could not be carried through the store and
+ *  signal that the customer has left, without recording a turnaround.
+ */
+void addict_lost(struct addict *addict)
+{
+    struct day *day = addict->day;
+
+    pool_free(&day->addicts, addict);
+    latch_done(&day->running, 1);
+}
+
+/* Thread body for a customer with a thread of their own. */
+void *addict_thread(void *addict)
+{
+    get_coffee(addict);
+    return NULL;
 }
 
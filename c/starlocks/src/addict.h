@@ -1,12 +1,18 @@
 #ifndef _ADDICT_H_
 #define _ADDICT_H_
 
-#include <sys/time.h>
+#include "timer.h"
+#include "cache.h"
 
 #define ATIME_SIMPLE    1<<18   /* Loop iterations */
 #define ATIME_COMPLEX   1<<19
 #define PAY_TIME        1<<18
 
+/* Nanoseconds per loop iteration, for modes that simulate time */
+#ifndef LOOP_NS
+#define LOOP_NS         1
+#endif
+
 #define ACOST_SIMPLE    200     /* In cents */
 #define ACOST_COMPLEX   450 
 
@@ -16,22 +22,44 @@ enum
     ATYPE_COMPLEX
 };
 
+struct stage;
+struct day;
+
+/*
+ * The order is written once, by whoever creates the addict, and read by
+ * every server after. The timing fields are written as the customer
+ * goes, by whichever thread serves it, so they get a cache line of
+ * their own. Allocate with init_addict(), from the line aligned addict
+ * pool of their day, so that neighbouring addicts never share a line
+ * either.
+ */
 struct addict {
+    /* Read-mostly */
+    int type;                   /* ATYPE_* of the order */
     unsigned int order_time;    /* Time for order completion */ 
     unsigned int order_cost;    /* Order cost */
+    unsigned long due;          /* Simulated arrival, in virtual ticks */
+    struct addict *link;        /* Next in a simulated queue */
+    struct day *day;            /* The day they are a customer of */
+
+    /* Written while being served */
+    stamp_t start cacheline_aligned; /* For timing measurement */
+    stamp_t end;
+    stamp_t arrived;            /* Arrival at the current stage */
+    stamp_t locked;             /* Got its entry lock */
+    stamp_t seated;             /* Got a service point there */
+    struct stage *stage;        /* Stage being visited */
+    unsigned int seed;          /* Picks the routes between stages */
     int caffeinated;            /* Is caffeinated */
-    struct server *server;      /* First server to go to */ 
-    struct server *next;        /* Optional next server */
-    struct timeval start;       /* Used for timing measurement */
-    struct timeval end;
-};
+} cacheline_aligned;
 
-struct addict *init_addict(unsigned int order_time, 
-        unsigned int order_cost, 
-        struct server *server, 
-        struct server *next);
+struct addict *init_addict(struct day *day, int type,
+        struct stage *entry, unsigned int seed);
 
 void get_coffee(struct addict *);
+void addict_done(struct addict *);
+void addict_lost(struct addict *);
+void *addict_thread(void *);
 
 #endif /* _ADDICT_H_ */
 
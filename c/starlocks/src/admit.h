@@ -0,0 +1,144 @@
+/*
+ * Admit - FIFO admission to a server's service points, in batches.
+ *
+ * Customers take a ticket with one atomic increment and wait for the
+ * "serving" word to reach it, as with ticket_lock.h. The customer at
+ * the head of the line waits for a service point, then takes every
+ * other point that is free, up to one for each customer queued behind
+ * it, and admits itself and all of them at once: one store of the
+ * serving word and a FUTEX_WAKE whose bitset covers each admitted
+ * ticket and the ticket of the new head. Admitted customers already
+ * hold their point and go straight in.
+ *
+ * Waiters sleep on one of ADMIT_WORDS futex words, each shared by 32
+ * tickets in turn, with their ticket's bit. So a wake only reaches
+ * the tickets it is for until over 32 * ADMIT_WORDS are waiting, and
+ * a batch of K takes a FUTEX_WAKE per 32 tickets.
+ *
+ * Under a FIFO lock each customer does a lock round of its own, and
+ * each has to be woken and run before it can hand the lock on, so K
+ * points freed together are handed out one wakeup after another.
+ * Here they take one round and the K customers wake in parallel.
+ * That is the intent; it is behind the experimental -B until a
+ * multi-core host shows it beating the lock (see bench_admit).
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _ADMIT_H_
+#define _ADMIT_H_
+
+#include <limits.h>
+#include <semaphore.h>
+#include "futex.h"
+#include "spin.h"
+#include "ticket_lock.h"
+
+#ifndef ADMIT_WORDS
+#define ADMIT_WORDS     16
+#endif
+
+typedef struct admit {
+    int next;                       /* Next ticket to hand out */
+    int serving;                    /* First ticket not admitted */
+    int wake[ADMIT_WORDS];          /* Futex words, see admit_word() */
+} admit_t;
+
+/* Static initializer */
+#define ADMIT_INIT { 0, 0, { 0 } }
+
+/* The futex word that the holder of the given ticket waits on */
+#define admit_word(admit, ticket) \
+    (&(admit)->wake[((unsigned int)(ticket) / 32) % ADMIT_WORDS])
+
+/* Has ticket a been reached by ticket b? Safe across wraparound. */
+#define admit_reached(a, b) \
+    ((int)((unsigned int)(b) - (unsigned int)(a)) >= 0)
+
+/* Dynamic initializer */
+static inline void admit_init(admit_t *admit)
+{
+    int i;
+    admit->next = 0;
+    admit->serving = 0;
+    for(i = 0; i < ADMIT_WORDS; i++)
+        admit->wake[i] = 0;
+}
+
+/*
+ * Take a ticket and block until it is admitted or at the head of the
+ *  line, spinning first under the given policy (which may be NULL).
+ *
+ * Returns 1 at the head of the line, with the ticket in *me; the
+ *  caller must then take a service point and call admit_serve().
+ *  Returns 0 once admitted by the head, with a point taken for us.
+ */
+static inline int admit_wait(admit_t *admit, int *me, spin_t *spin)
+{
+    int cnt, limit, cur, gen, *word;
+
+    *me = __atomic_fetch_add(&admit->next, 1, __ATOMIC_SEQ_CST);
+    cur = __atomic_load_n(&admit->serving, __ATOMIC_ACQUIRE);
+    if(admit_reached(*me, cur))
+        return cur == *me;
+
+    limit = spin_limit(spin);
+    for(cnt = 0; cnt < limit; cnt++) {
+        if(admit_reached(*me,
+                    __atomic_load_n(&admit->serving, __ATOMIC_ACQUIRE)))
+            break;
+        cpu_relax();
+    }
+    spin_update(spin, cnt);
+
+    /* Read the word first, so that a wake after the check is never lost */
+    word = admit_word(admit, *me);
+    for(;;) {
+        gen = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+        cur = __atomic_load_n(&admit->serving, __ATOMIC_SEQ_CST);
+        if(admit_reached(*me, cur))
+            break;
+        futex_wait_bitset(word, gen, ticket_bit(*me));
+    }
+    return cur == *me;
+}
+
+/* Returns the number of customers queued behind the head, ticket me. */
+static inline int admit_behind(admit_t *admit, int me)
+{
+    return (unsigned int)__atomic_load_n(&admit->next, __ATOMIC_SEQ_CST) -
+        (unsigned int)me - 1;
+}
+
+/*
+ * Admit the head of the line, ticket me, along with the n customers
+ *  behind it (n at most admit_behind()), for whom it has taken a
+ *  service point each. Wakes them and the new head, if anyone is
+ *  waiting, with a system call for each futex word they wait on.
+ *
+ * Tickets are counted unsigned here, so that they wrap as the ticket
+ *  grab does instead of overflowing.
+ */
+static inline void admit_serve(admit_t *admit, int me, int n)
+{
+    unsigned int i, next = (unsigned int)me + 1 + n;
+    int bits = 0, *word;
+
+    /* Ordered against the ticket grab so a new waiter is never missed */
+    __atomic_store_n(&admit->serving, (int)next, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&admit->next, __ATOMIC_SEQ_CST) == (int)next && !n)
+        return;
+    for(i = (unsigned int)me + 1; i != next + 1; i++) {
+        word = admit_word(admit, i);
+        bits |= ticket_bit(i);
+        /* Wake each word once, with the bits of all its tickets */
+        if(i == next || admit_word(admit, i + 1) != word) {
+            __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+            futex_wake_bitset(word, INT_MAX, bits);
+            bits = 0;
+        }
+    }
+}
+
+#endif /* _ADMIT_H_ */
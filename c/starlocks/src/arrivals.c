@@ -0,0 +1,128 @@
+/*
+ * arrivals - When the day's customers walk in. See arrivals.h.
+ *
+ * Random draws come from the generator passed in, so schedules drawn
+ * with generators of their own never interfere.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arrivals.h"
+#include "check.h"
+
+/* Returns a normally distributed random number (Box-Muller). */
+static double normal(rng_t *rng, double mean, double sd)
+{
+    double u = 1.0 - rng_double(rng);
+
+    return mean + sd * sqrt(-2.0 * log(u)) *
+        cos(2.0 * M_PI * rng_double(rng));
+}
+
+/*
+ * Set up arrivals by spec, as described in arrivals.h, or a closed
+ *  burst if spec is NULL.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int init_arrivals(struct arrivals *arrivals, const char *spec)
+{
+    int ret = 1;
+    const char *args;
+
+    memset(arrivals, 0, sizeof(*arrivals));
+    if(!spec)
+        return 0;
+    args = strchr(spec, ':');
+    check(!args, out);
+    args++;
+
+    if(!strncmp(spec, "exp:", 4)) {
+        arrivals->dist = ARRIVE_EXP;
+        check(sscanf(args, "%lf", &arrivals->a) != 1, out);
+    } else if(!strncmp(spec, "uniform:", 8)) {
+        arrivals->dist = ARRIVE_UNIFORM;
+        check(sscanf(args, "%lf:%lf", &arrivals->a, &arrivals->b) != 2, out);
+        check(arrivals->b < arrivals->a, out);
+    } else if(!strncmp(spec, "normal:", 7)) {
+        arrivals->dist = ARRIVE_NORMAL;
+        check(sscanf(args, "%lf:%lf", &arrivals->a, &arrivals->b) != 2, out);
+    } else if(!strncmp(spec, "trace:", 6)) {
+        arrivals->dist = ARRIVE_TRACE;
+        arrivals->trace = fopen(args, "r");
+        check(!arrivals->trace, out);
+    } else {
+        goto out;
+    }
+    check(arrivals->a < 0 || arrivals->b < 0, out);
+    ret = 0;
+out:
+    return ret;
+}
+
+/* Close the trace being replayed, if any. */
+void destroy_arrivals(struct arrivals *arrivals)
+{
+    if(arrivals->trace)
+        fclose(arrivals->trace);
+    arrivals->trace = NULL;
+}
+
+/* Start the schedule over, for a new day. */
+void arrivals_rewind(struct arrivals *arrivals)
+{
+    arrivals->due = 0;
+    if(arrivals->trace)
+        rewind(arrivals->trace);
+}
+
+/* Returns the next inter-arrival time from the trace, in usecs. */
+static double trace_next(struct arrivals *arrivals)
+{
+    double gap;
+    int tries;
+
+    /* Start over once, at the end of the trace */
+    for(tries = 0; tries < 2; tries++) {
+        if(fscanf(arrivals->trace, "%lf", &gap) == 1)
+            return gap > 0 ? gap : 0;
+        rewind(arrivals->trace);
+    }
+    return 0;
+}
+
+/*
+ * Schedule the next customer, drawing from rng.
+ *
+ * Returns the time they arrive, in nanoseconds since the start of the
+ *  day. Every customer of a closed burst arrives at 0.
+ */
+unsigned long arrivals_next(struct arrivals *arrivals, rng_t *rng)
+{
+    double gap;
+
+    switch(arrivals->dist) {
+        case ARRIVE_EXP:
+            gap = -arrivals->a * log(1.0 - rng_double(rng));
+            break;
+        case ARRIVE_UNIFORM:
+            gap = arrivals->a + (arrivals->b - arrivals->a) *
+                rng_double(rng);
+            break;
+        case ARRIVE_NORMAL:
+            gap = normal(rng, arrivals->a, arrivals->b);
+            break;
+        case ARRIVE_TRACE:
+            gap = trace_next(arrivals);
+            break;
+        default:
+            gap = 0;
+    }
+    if(gap > 0)
+        arrivals->due += (unsigned long)(gap * 1000);
+    return arrivals->due;
+}
@@ -0,0 +1,51 @@
+/*
+ * arrivals - When the day's customers walk in.
+ *
+ * By default the whole day arrives at once, as fast as customers can
+ * be sent off (a closed burst). Otherwise arrivals are open-loop: each
+ * customer is scheduled a random inter-arrival time after the last,
+ * whether or not the store has kept up, and is timed from that
+ * scheduled arrival rather than from when they were actually let in.
+ *
+ * Inter-arrival times are drawn from one of:
+ *
+ *  exp:<mean>          Exponential (Poisson arrivals)
+ *  uniform:<lo>:<hi>   Uniform between lo and hi
+ *  normal:<mean>:<sd>  Normal, cut off at zero
+ *  trace:<file>        Replayed from a file of inter-arrival times, one
+ *                      per line, starting over at the end of the file
+ *
+ * All times are in microseconds.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _ARRIVALS_H_
+#define _ARRIVALS_H_
+
+#include <stdio.h>
+#include "rng.h"
+
+enum
+{
+    ARRIVE_CLOSED,
+    ARRIVE_EXP,
+    ARRIVE_UNIFORM,
+    ARRIVE_NORMAL,
+    ARRIVE_TRACE
+};
+
+struct arrivals {
+    int dist;                   /* ARRIVE_* distribution */
+    double a, b;                /* Its parameters, in usecs */
+    FILE *trace;                /* Trace being replayed */
+    unsigned long due;          /* Time of the last arrival, in nsecs */
+};
+
+int init_arrivals(struct arrivals *, const char *spec);
+void destroy_arrivals(struct arrivals *);
+void arrivals_rewind(struct arrivals *);
+unsigned long arrivals_next(struct arrivals *, rng_t *);
+
+#endif /* _ARRIVALS_H_ */
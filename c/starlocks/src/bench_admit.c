@@ -0,0 +1,301 @@
+/*
+ * bench_admit - Entry to a server's service points, one at a time
+ *  against in batches.
+ *
+ * Runs a number of threads that each enter one of a number of service
+ * points in a loop: enter, a busy loop of cs_loops iterations at the
+ * point, leave, then think_loops iterations outside. Every combination
+ * of the thread counts, point counts, and service and think lengths
+ * asked for is run for a fixed time with each of
+ *
+ *  lock        the server's entry lock: the FIFO mutex of this build
+ *              (see fifo_mutex_types.h), holding it while waiting on
+ *              the service point semaphore, as server_enter() does
+ *  batch       the batched admission of admit.h, as with -B
+ *
+ * Each run reports its throughput, the percentiles of the time taken
+ * to enter (from asking for a point to holding one) and, for batch,
+ * the average number of customers that each head of the line let in.
+ * Both waits park straight away, as without -a. The point counts are
+ * where batching matters: the more points free up at once, the longer
+ * the chain of wakeups that the lock hands them out through.
+ *
+ * Results are written as tab separated lines under a header line, to
+ * stdout and to results_file if given, for tracking across releases.
+ *
+ * Usage: ./bench_admit [-t threads] [-p points] [-c cs_loops]
+ *          [-w think_loops] [-d msecs] [-o results_file]
+ *  threads, points, cs_loops and think_loops are comma separated
+ *  lists.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "fifo_mutex.h"
+#include "admit.h"
+#include "hist.h"
+#include "timer.h"
+#include "cache.h"
+#include "check.h"
+
+#define BENCH_VALUES    16      /* Values per swept parameter */
+
+enum
+{
+    ADMIT_LOCK,
+    ADMIT_BATCH,
+    ADMIT_TYPES
+};
+
+static const char *admit_names[ADMIT_TYPES] = {
+    "lock", "batch"
+};
+
+/* A thread entering the server, and what it saw */
+struct customer {
+    pthread_t thread;
+    long ops;                           /* Entries */
+    long heads;                         /* Times at the head, for batch */
+    long admitted;                      /* Let in while at the head */
+    hist_t hist;                        /* Time to enter, in nsecs */
+} cacheline_aligned;
+
+/* The server under test */
+static struct {
+    fifo_mutex_t lock;
+    admit_t admit cacheline_aligned;
+    sem_t points cacheline_aligned;
+} server cacheline_aligned;
+
+static int type;                        /* Entry under test */
+static int cs_loops;                    /* Busy loop at the point */
+static int think_loops;                 /* And between entries */
+static int stop;                        /* Time is up */
+
+/* Enter a service point, counting what we let in at the head. */
+static inline void bench_enter(struct customer *me)
+{
+    int ticket, n, behind;
+
+    if(type == ADMIT_LOCK) {
+        fifo_mutex_lock(&server.lock);
+        sem_wait(&server.points);
+        fifo_mutex_unlock(&server.lock);
+        return;
+    }
+    if(!admit_wait(&server.admit, &ticket, NULL))
+        return;
+    sem_wait(&server.points);
+    behind = admit_behind(&server.admit, ticket);
+    for(n = 0; n < behind && !sem_trywait(&server.points); n++);
+    admit_serve(&server.admit, ticket, n);
+    me->heads++;
+    me->admitted += n + 1;
+}
+
+/* Body of a customer thread. */
+static void *customer(void *arg)
+{
+    struct customer *me = arg;
+    stamp_t asked;
+    volatile int cnt;
+
+    while(!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        asked = timer_now();
+        bench_enter(me);
+        hist_record(&me->hist, timer_ns(asked, timer_now()));
+        for(cnt = 0; cnt < cs_loops; cnt++) {};
+        sem_post(&server.points);
+        me->ops++;
+        for(cnt = 0; cnt < think_loops; cnt++) {};
+    }
+    return NULL;
+}
+
+/* Write the line to both outputs. */
+static void report(FILE *results, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void report(FILE *results, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    if(results) {
+        va_start(args, fmt);
+        vfprintf(results, fmt, args);
+        va_end(args);
+    }
+}
+
+/*
+ * Run n threads against a server of the given number of points for
+ *  msecs, and report what they saw.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static int run(int n, int points, int msecs, FILE *results)
+{
+    int i, ret = 1;
+    long ops = 0, heads = 0, admitted = 0;
+    stamp_t start, end;
+    struct timespec pause = { msecs / 1000, (msecs % 1000) * 1000000l };
+    struct customer *customers;
+    hist_t *hist = malloc(sizeof(hist_t));
+    check(!hist, out);
+    check(posix_memalign((void **)&customers, CACHELINE_SIZE,
+                n * sizeof(struct customer)), free_hist);
+    check(fifo_mutex_init(&server.lock), free_customers);
+    admit_init(&server.admit);
+    check(sem_init(&server.points, 0, points), destroy_lock);
+
+    memset(customers, 0, n * sizeof(struct customer));
+    __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+    start = timer_now();
+    for(i = 0; i < n; i++)
+        if(pthread_create(&customers[i].thread, NULL, customer,
+                    &customers[i]))
+            break;
+    nanosleep(&pause, NULL);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    n = i;
+    for(i = 0; i < n; i++)
+        pthread_join(customers[i].thread, NULL);
+    end = timer_now();
+    check_pr(!n, "Failed to start threads", destroy_sem);
+
+    init_hist(hist);
+    for(i = 0; i < n; i++) {
+        hist_merge(hist, &customers[i].hist);
+        ops += customers[i].ops;
+        heads += customers[i].heads;
+        admitted += customers[i].admitted;
+    }
+    report(results, "%s\t%d\t%d\t%d\t%d\t%.0f\t%lu\t%lu\t%lu\t%lu\t%.2f\n",
+            admit_names[type], n, points, cs_loops, think_loops,
+            ops / (timer_ns(start, end) / 1e9),
+            hist_percentile(hist, 0.5), hist_percentile(hist, 0.9),
+            hist_percentile(hist, 0.99), hist->max,
+            heads ? (double)admitted / heads : 1);
+    ret = 0;
+destroy_sem:
+    sem_destroy(&server.points);
+destroy_lock:
+    fifo_mutex_destroy(&server.lock);
+free_customers:
+    free(customers);
+free_hist:
+    free(hist);
+out:
+    return ret;
+}
+
+/*
+ * Read a comma separated list of numbers into values.
+ *
+ * Returns the number of values, or 0 on a malformed list.
+ */
+static int read_list(const char *list, int *values)
+{
+    int n = 0, len;
+
+    while(*list && n < BENCH_VALUES) {
+        if(sscanf(list, "%d%n", &values[n], &len) != 1 || values[n] < 0)
+            return 0;
+        n++;
+        list += len;
+        if(*list == ',')
+            list++;
+        else if(*list)
+            return 0;
+    }
+    return *list ? 0 : n;
+}
+
+int main(int argc, char **argv)
+{
+    int opt, t, p, c, w, msecs = 100;
+    int threads[BENCH_VALUES], points[BENCH_VALUES];
+    int cs[BENCH_VALUES], think[BENCH_VALUES];
+    int n_threads, n_points, n_cs, n_think;
+    FILE *results = NULL;
+
+    n_threads = read_list("64,256", threads);
+    n_points = read_list("1,4,16,64,256", points);
+    n_cs = read_list("1000", cs);
+    n_think = read_list("1000", think);
+
+    while((opt = getopt(argc, argv, "t:p:c:w:d:o:")) != -1) {
+        switch(opt) {
+            case 't':
+                n_threads = read_list(optarg, threads);
+                check_pr(!n_threads, "Bad list of threads", usage);
+                break;
+            case 'p':
+                n_points = read_list(optarg, points);
+                check_pr(!n_points, "Bad list of points", usage);
+                break;
+            case 'c':
+                n_cs = read_list(optarg, cs);
+                check_pr(!n_cs, "Bad list of service times", usage);
+                break;
+            case 'w':
+                n_think = read_list(optarg, think);
+                check_pr(!n_think, "Bad list of think times", usage);
+                break;
+            case 'd':
+                msecs = atoi(optarg);
+                check_pr(msecs < 1, "Runs must last a millisecond", usage);
+                break;
+            case 'o':
+                if(results)
+                    fclose(results);
+                results = fopen(optarg, "w");
+                check_pr(!results, "Cannot open results file", usage);
+                break;
+            default:
+                goto usage;
+        }
+    }
+    for(t = 0; t < n_threads; t++)
+        check_pr(!threads[t], "Need at least one thread", usage);
+    for(p = 0; p < n_points; p++)
+        check_pr(!points[p], "Need at least one point", usage);
+
+    report(results, "# %lu ns per timestamp, %d ms per run\n",
+            timer_cost(100000), msecs);
+    report(results, "Admit\tThreads\tPoints\tCS\tThink\tOps/s"
+            "\tP50_ns\tP90_ns\tP99_ns\tMax_ns\tBatch\n");
+    for(t = 0; t < n_threads; t++)
+        for(p = 0; p < n_points; p++)
+            for(c = 0; c < n_cs; c++)
+                for(w = 0; w < n_think; w++)
+                    for(type = 0; type < ADMIT_TYPES; type++) {
+                        cs_loops = cs[c];
+                        think_loops = think[w];
+                        check(run(threads[t], points[p], msecs, results),
+                                close);
+                    }
+    if(results)
+        fclose(results);
+    return 0;
+usage:
+    printf("Usage: bench_admit [-t threads] [-p points] [-c cs_loops] "
+            "[-w think_loops] [-d msecs] [-o results_file]\n");
+    return 1;
+close:
+    if(results)
+        fclose(results);
+    return 1;
+}
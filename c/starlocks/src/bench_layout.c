@@ -0,0 +1,314 @@
+/*
+ * bench_layout - Cache misses taken by customers passing through servers.
+ *
+ * Runs 1..max_threads customer threads over a line of servers, thread i
+ * using server i % n_servers. Each pass takes the entry lock, claims a
+ * service point, releases the lock, records a time in the server's
+ * histogram (its CPU's shard of it, in the aligned layout) and frees
+ * the service point again- the same shared writes
+ * server_enter(), server_leave() and server_record() make. The servers
+ * are laid out in turn as the original struct server, allocated back to
+ * back, and as the current cache line aligned struct server.
+ *
+ * Cache misses are counted across all threads with perf_event_open(2);
+ * where the kernel does not allow that (see perf_event_paranoid) the
+ * columns read "-" and only the pass rate is reported.
+ *
+ * Usage: ./bench_layout [max_threads] [n_servers] [passes]
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "server.h"
+#include "check.h"
+#ifndef CHAOS
+#include "fifo_mutex.h"
+#endif
+
+#ifndef CHAOS
+#define server_lock(lock)       fifo_mutex_lock(lock)
+#define server_unlock(lock)     fifo_mutex_unlock(lock)
+typedef fifo_mutex_t server_lock_t;
+#else
+#define server_lock(lock)       pthread_mutex_lock(lock)
+#define server_unlock(lock)     pthread_mutex_unlock(lock)
+typedef pthread_mutex_t server_lock_t;
+#endif
+
+/* struct server as it was before its fields were grouped by writer */
+struct packed_server {
+    const char *name;
+    int max_service;
+    sem_t service_sem;
+    spin_t sem_spin;
+    fiber_sem_t fiber_slots;
+    struct {
+        int free;
+        struct addict *front;
+        struct addict *back;
+    } des;
+    hist_t hist;
+    server_lock_t lock;
+};
+
+enum
+{
+    LAYOUT_PACKED,
+    LAYOUT_ALIGNED,
+    LAYOUT_TYPES
+};
+
+static const char *layout_names[LAYOUT_TYPES] = {
+    "packed", "aligned"
+};
+
+/* The shared fields of one server, in whichever layout is under test */
+struct bench_server {
+    server_lock_t *lock;
+    sem_t *service_sem;
+    hist_t *hist;                       /* Packed */
+    struct server_shard *shards;        /* Aligned, NULL if packed */
+};
+
+enum
+{
+    PERF_CACHE_MISSES,
+    PERF_L1D_MISSES,
+    PERF_COUNTERS
+};
+
+static struct bench_server *servers;
+static int n_servers = 3;
+static long passes = 200000;
+
+/* Histogram that the calling thread should record into */
+static inline hist_t *bench_hist(struct bench_server *server)
+{
+    int cpu;
+    if(!server->shards)
+        return server->hist;
+    cpu = sched_getcpu();
+    if(cpu < 0)
+        cpu = 0;
+    return &server->shards[cpu % SERVER_SHARDS].hist;
+}
+
+/* Body of a customer thread. */
+static void *customer(void *arg)
+{
+    struct bench_server *server = arg;
+    long i;
+
+    for(i = 0; i < passes; i++) {
+        server_lock(server->lock);
+        sem_wait(server->service_sem);
+        server_unlock(server->lock);
+        hist_record(bench_hist(server), i & 1023);
+        sem_post(server->service_sem);
+    }
+    return NULL;
+}
+
+/*
+ * Open a counter for the given hardware event, counting this thread and
+ * every thread it creates from now on.
+ *
+ * Returns the counter's fd, or -1 if it isn't available.
+ */
+static int perf_open(unsigned int type, unsigned long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Returns the count read from the given counter, or -1. */
+static long perf_read(int fd)
+{
+    long long val;
+
+    if(fd < 0 || read(fd, &val, sizeof(val)) != sizeof(val))
+        return -1;
+    return val;
+}
+
+/*
+ * Lay out n_servers servers in the given layout and point servers at
+ * their shared fields.
+ *
+ * Returns the memory holding the servers, or NULL on failure.
+ */
+static void *init_layout(int layout)
+{
+    int i;
+    void *mem;
+    struct packed_server *packed;
+    struct server *aligned;
+
+    if(layout == LAYOUT_PACKED)
+        mem = calloc(n_servers, sizeof(struct packed_server));
+    else if(posix_memalign(&mem, CACHELINE_SIZE,
+                n_servers * sizeof(struct server)))
+        mem = NULL;
+    check(!mem, out);
+    packed = mem;
+    aligned = mem;
+
+    for(i = 0; i < n_servers; i++) {
+        if(layout == LAYOUT_PACKED) {
+            servers[i].lock = &packed[i].lock;
+            servers[i].service_sem = &packed[i].service_sem;
+            servers[i].hist = &packed[i].hist;
+            servers[i].shards = NULL;
+            init_hist(servers[i].hist);
+        } else {
+            servers[i].lock = &aligned[i].lock;
+            servers[i].service_sem = &aligned[i].service_sem;
+            servers[i].shards = aligned[i].shards;
+            memset(servers[i].shards, 0, sizeof(aligned[i].shards));
+        }
+        #ifndef CHAOS
+        fifo_mutex_init(servers[i].lock);
+        #else
+        pthread_mutex_init(servers[i].lock, NULL);
+        #endif
+        sem_init(servers[i].service_sem, 0, 1);
+    }
+out:
+    return mem;
+}
+
+/* Release the servers laid out by init_layout(), and their memory. */
+static void destroy_layout(void *mem)
+{
+    int i;
+
+    for(i = 0; i < n_servers; i++) {
+        #ifndef CHAOS
+        fifo_mutex_destroy(servers[i].lock);
+        #else
+        pthread_mutex_destroy(servers[i].lock);
+        #endif
+        sem_destroy(servers[i].service_sem);
+    }
+    free(mem);
+}
+
+/*
+ * Time n customers passing through the servers, counting cache misses
+ * into misses[].
+ *
+ * Returns the number of passes per second, or -1 on failure.
+ */
+static double run(int n, long misses[PERF_COUNTERS])
+{
+    int i, fds[PERF_COUNTERS];
+    double secs, ret = -1;
+    struct timespec start, end;
+    pthread_t *threads = malloc(n * sizeof(pthread_t));
+    check(!threads, out);
+
+    fds[PERF_CACHE_MISSES] = perf_open(PERF_TYPE_HARDWARE,
+            PERF_COUNT_HW_CACHE_MISSES);
+    fds[PERF_L1D_MISSES] = perf_open(PERF_TYPE_HW_CACHE,
+            PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    for(i = 0; i < PERF_COUNTERS; i++)
+        if(fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < n; i++)
+        check(pthread_create(&threads[i], NULL, customer,
+                    &servers[i % n_servers]), join);
+join:
+    n = i;
+    for(i = 0; i < n; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for(i = 0; i < PERF_COUNTERS; i++) {
+        if(fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        misses[i] = perf_read(fds[i]);
+        if(fds[i] >= 0)
+            close(fds[i]);
+    }
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    ret = n * passes / secs;
+    free(threads);
+out:
+    return ret;
+}
+
+/* Print a miss count per pass, or "-" if it wasn't counted. */
+static void print_misses(long misses, long n_passes)
+{
+    if(misses < 0)
+        printf("\t-");
+    else
+        printf("\t%.2f", (double)misses / n_passes);
+}
+
+int main(int argc, char **argv)
+{
+    int n, layout, max_threads = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+    long misses[PERF_COUNTERS];
+    double rate;
+    void *mem;
+
+    if(argc > 1)
+        max_threads = atoi(argv[1]);
+    if(argc > 2)
+        n_servers = atoi(argv[2]);
+    if(argc > 3)
+        passes = atol(argv[3]);
+    check_pr(max_threads < 1 || n_servers < 1 || passes < 1,
+            "Usage: bench_layout [max_threads] [n_servers] [passes]",
+            out);
+    servers = malloc(n_servers * sizeof(struct bench_server));
+    check(!servers, out);
+
+    printf("Layout\tThreads\tPasses/s\tLLC-misses/pass\tL1d-misses/pass\n");
+    for(layout = 0; layout < LAYOUT_TYPES; layout++) {
+        for(n = 1; n <= max_threads; n *= 2) {
+            mem = init_layout(layout);
+            check(!mem, free_servers);
+            rate = run(n, misses);
+            destroy_layout(mem);
+            check(rate < 0, free_servers);
+            printf("%s\t%d\t%.0f", layout_names[layout], n, rate);
+            print_misses(misses[PERF_CACHE_MISSES], n * passes);
+            print_misses(misses[PERF_L1D_MISSES], n * passes);
+            printf("\n");
+        }
+    }
+    free(servers);
+    return 0;
+free_servers:
+    free(servers);
+out:
+    return 1;
+}
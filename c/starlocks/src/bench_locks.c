@@ -0,0 +1,402 @@
+/*
+ * bench_locks - Lock implementations against each other, in isolation.
+ *
+ * Runs a number of threads that each take a lock in a loop: acquire,
+ * a critical section of cs_loops busy-loop iterations, release, then
+ * think_loops iterations outside the lock. Every combination of the
+ * thread counts, critical section and think lengths asked for is run
+ * for a fixed time against each of
+ *
+ *  fifo_mutex  the FIFO mutex of this build (MCS, ticket or queue,
+ *              see fifo_mutex_types.h)
+ *  pthread     a default pthread mutex, as in the CHAOS build
+ *  spin        a test-and-test-and-set spinlock, yielding the CPU
+ *              after SPIN_MAX polls
+ *  ticket      ticket_lock.h on its own, parking straight away
+ *  mcs         mcs_lock.h on its own, parking straight away
+ *
+ * Each run reports its throughput, the percentiles of its handoff
+ * latency (from a release to the acquisition by a thread that was
+ * already waiting for it) and the fairness of the lock: the smallest
+ * thread's share of acquisitions over the largest's, and the
+ * coefficient of variation of the per-thread acquisitions. Every
+ * iteration takes three timestamps (see timer_cost()) whatever the
+ * lock, so throughputs compare between locks but not with the bare
+ * lock cost.
+ *
+ * Results are written as tab separated lines under a header line, to
+ * stdout and to results_file if given, for tracking across releases.
+ *
+ * Usage: ./bench_locks [-t threads] [-c cs_loops] [-w think_loops]
+ *          [-d msecs] [-o results_file]
+ *  threads, cs_loops and think_loops are comma separated lists.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "fifo_mutex.h"
+#include "mcs_lock.h"
+#include "ticket_lock.h"
+#include "spin.h"
+#include "hist.h"
+#include "timer.h"
+#include "cache.h"
+#include "check.h"
+
+#if defined(FIFO_QUEUE)
+#define FIFO_MUTEX_NAME "fifo_mutex/queue"
+#elif defined(FIFO_TICKET)
+#define FIFO_MUTEX_NAME "fifo_mutex/ticket"
+#else
+#define FIFO_MUTEX_NAME "fifo_mutex/mcs"
+#endif
+
+#define BENCH_VALUES    16      /* Values per swept parameter */
+
+enum
+{
+    LOCK_FIFO,
+    LOCK_PTHREAD,
+    LOCK_SPIN,
+    LOCK_TICKET,
+    LOCK_MCS,
+    LOCK_TYPES
+};
+
+static const char *lock_names[LOCK_TYPES] = {
+    FIFO_MUTEX_NAME, "pthread", "spin", "ticket", "mcs"
+};
+
+/* A thread taking the lock, and what it saw */
+struct locker {
+    int id;
+    pthread_t thread;
+    mcs_node_t node;                    /* For LOCK_MCS */
+    long ops;                           /* Acquisitions */
+    hist_t hist;                        /* Handoff latency, in nsecs */
+} cacheline_aligned;
+
+/* The lock under test */
+static struct {
+    fifo_mutex_t fifo;
+    pthread_mutex_t mutex;
+    int spin;
+    ticket_lock_t ticket;
+    mcs_lock_t mcs;
+} locks cacheline_aligned;
+
+/* The last release, written and read under the lock */
+static struct {
+    stamp_t released;
+    int owner;
+} last cacheline_aligned;
+
+static int type;                        /* Lock under test */
+static int cs_loops;                    /* Busy loop inside the lock */
+static int think_loops;                 /* And between acquisitions */
+static int stop;                        /* Time is up */
+
+/* Take the test-and-test-and-set spinlock. */
+static inline void tas_lock(int *lock)
+{
+    int cnt;
+
+    while(__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+        for(cnt = 0; __atomic_load_n(lock, __ATOMIC_RELAXED); cnt++) {
+            if(cnt < SPIN_MAX)
+                cpu_relax();
+            else
+                sched_yield();
+        }
+}
+
+static inline void tas_unlock(int *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static inline void bench_lock(struct locker *me)
+{
+    switch(type) {
+        case LOCK_FIFO:
+            fifo_mutex_lock(&locks.fifo);
+            break;
+        case LOCK_PTHREAD:
+            pthread_mutex_lock(&locks.mutex);
+            break;
+        case LOCK_SPIN:
+            tas_lock(&locks.spin);
+            break;
+        case LOCK_TICKET:
+            ticket_lock(&locks.ticket, NULL);
+            break;
+        default:
+            mcs_lock(&locks.mcs, &me->node, NULL);
+    }
+}
+
+static inline void bench_unlock(struct locker *me)
+{
+    switch(type) {
+        case LOCK_FIFO:
+            fifo_mutex_unlock(&locks.fifo);
+            break;
+        case LOCK_PTHREAD:
+            pthread_mutex_unlock(&locks.mutex);
+            break;
+        case LOCK_SPIN:
+            tas_unlock(&locks.spin);
+            break;
+        case LOCK_TICKET:
+            ticket_unlock(&locks.ticket);
+            break;
+        default:
+            mcs_unlock(&locks.mcs, &me->node);
+    }
+}
+
+/* Body of a locking thread. */
+static void *locker(void *arg)
+{
+    struct locker *me = arg;
+    stamp_t asked, got;
+    volatile int cnt;
+
+    while(!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        asked = timer_now();
+        bench_lock(me);
+        got = timer_now();
+        /* Handed over by another thread while we were waiting */
+        if(last.owner != me->id && last.released > asked)
+            hist_record(&me->hist, timer_ns(last.released, got));
+        for(cnt = 0; cnt < cs_loops; cnt++) {};
+        last.owner = me->id;
+        last.released = timer_now();
+        bench_unlock(me);
+        me->ops++;
+        for(cnt = 0; cnt < think_loops; cnt++) {};
+    }
+    return NULL;
+}
+
+/* Set up the lock under test. Returns 0 on success. */
+static int init_lock(void)
+{
+    int ret = 0;
+
+    switch(type) {
+        case LOCK_FIFO:
+            ret = fifo_mutex_init(&locks.fifo);
+            break;
+        case LOCK_PTHREAD:
+            ret = pthread_mutex_init(&locks.mutex, NULL);
+            break;
+        case LOCK_SPIN:
+            locks.spin = 0;
+            break;
+        case LOCK_TICKET:
+            ticket_lock_init(&locks.ticket);
+            break;
+        default:
+            mcs_lock_init(&locks.mcs);
+    }
+    last.owner = -1;
+    last.released = 0;
+    return ret;
+}
+
+static void destroy_lock(void)
+{
+    if(type == LOCK_FIFO)
+        fifo_mutex_destroy(&locks.fifo);
+    else if(type == LOCK_PTHREAD)
+        pthread_mutex_destroy(&locks.mutex);
+}
+
+/* Write the line to both outputs. */
+static void report(FILE *results, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void report(FILE *results, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    if(results) {
+        va_start(args, fmt);
+        vfprintf(results, fmt, args);
+        va_end(args);
+    }
+}
+
+/*
+ * Run n threads against the lock under test for msecs, and report
+ *  what they saw.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static int run(int n, int msecs, FILE *results)
+{
+    int i, ret = 1;
+    double secs, mean = 0, var = 0;
+    long min, max;
+    stamp_t start, end;
+    struct timespec pause = { msecs / 1000, (msecs % 1000) * 1000000l };
+    struct locker *lockers;
+    hist_t *hist = malloc(sizeof(hist_t));
+    check(!hist, out);
+    check(posix_memalign((void **)&lockers, CACHELINE_SIZE,
+                n * sizeof(struct locker)), free_hist);
+    check(init_lock(), free_lockers);
+
+    memset(lockers, 0, n * sizeof(struct locker));
+    __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+    start = timer_now();
+    for(i = 0; i < n; i++) {
+        lockers[i].id = i;
+        if(pthread_create(&lockers[i].thread, NULL, locker, &lockers[i]))
+            break;
+    }
+    nanosleep(&pause, NULL);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    n = i;
+    for(i = 0; i < n; i++)
+        pthread_join(lockers[i].thread, NULL);
+    end = timer_now();
+    check_pr(!n, "Failed to start threads", destroy);
+
+    /* Pool the handoffs and spread the acquisitions */
+    init_hist(hist);
+    min = max = lockers[0].ops;
+    for(i = 0; i < n; i++) {
+        hist_merge(hist, &lockers[i].hist);
+        mean += lockers[i].ops;
+        min = lockers[i].ops < min ? lockers[i].ops : min;
+        max = lockers[i].ops > max ? lockers[i].ops : max;
+    }
+    mean /= n;
+    for(i = 0; i < n; i++)
+        var += (lockers[i].ops - mean) * (lockers[i].ops - mean);
+    var /= n;
+    secs = timer_ns(start, end) / 1e9;
+
+    report(results, "%s\t%d\t%d\t%d\t%.0f\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu"
+            "\t%.3f\t%.3f\n", lock_names[type], n, cs_loops, think_loops,
+            mean * n / secs, hist->count,
+            hist_percentile(hist, 0.5), hist_percentile(hist, 0.9),
+            hist_percentile(hist, 0.99), hist_percentile(hist, 0.999),
+            hist->max, max ? (double)min / max : 0,
+            mean ? sqrt(var) / mean : 0);
+    ret = 0;
+destroy:
+    destroy_lock();
+free_lockers:
+    free(lockers);
+free_hist:
+    free(hist);
+out:
+    return ret;
+}
+
+/*
+ * Read a comma separated list of numbers into values.
+ *
+ * Returns the number of values, or 0 on a malformed list.
+ */
+static int read_list(const char *list, int *values)
+{
+    int n = 0, len;
+
+    while(*list && n < BENCH_VALUES) {
+        if(sscanf(list, "%d%n", &values[n], &len) != 1 || values[n] < 0)
+            return 0;
+        n++;
+        list += len;
+        if(*list == ',')
+            list++;
+        else if(*list)
+            return 0;
+    }
+    return *list ? 0 : n;
+}
+
+int main(int argc, char **argv)
+{
+    int opt, t, c, w, msecs = 100;
+    int threads[BENCH_VALUES], cs[BENCH_VALUES], think[BENCH_VALUES];
+    int n_threads = 0, n_cs, n_think;
+    int max_threads = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+    FILE *results = NULL;
+
+    /* Powers of two up to twice the CPUs, and at least up to 4 */
+    for(t = 1; t <= max_threads || t <= 4; t *= 2)
+        threads[n_threads++] = t;
+    n_cs = read_list("0,100,1000", cs);
+    n_think = read_list("0,1000", think);
+
+    while((opt = getopt(argc, argv, "t:c:w:d:o:")) != -1) {
+        switch(opt) {
+            case 't':
+                n_threads = read_list(optarg, threads);
+                check_pr(!n_threads, "Bad list of threads", usage);
+                break;
+            case 'c':
+                n_cs = read_list(optarg, cs);
+                check_pr(!n_cs, "Bad list of critical sections", usage);
+                break;
+            case 'w':
+                n_think = read_list(optarg, think);
+                check_pr(!n_think, "Bad list of think times", usage);
+                break;
+            case 'd':
+                msecs = atoi(optarg);
+                check_pr(msecs < 1, "Runs must last a millisecond", usage);
+                break;
+            case 'o':
+                if(results)
+                    fclose(results);
+                results = fopen(optarg, "w");
+                check_pr(!results, "Cannot open results file", usage);
+                break;
+            default:
+                goto usage;
+        }
+    }
+    for(t = 0; t < n_threads; t++)
+        check_pr(!threads[t], "Need at least one thread", usage);
+
+    report(results, "# %lu ns per timestamp, %d ms per run\n",
+            timer_cost(100000), msecs);
+    report(results, "Lock\tThreads\tCS\tThink\tOps/s\tHandoffs"
+            "\tP50_ns\tP90_ns\tP99_ns\tP99.9_ns\tMax_ns\tMin/Max\tCV\n");
+    for(type = 0; type < LOCK_TYPES; type++)
+        for(t = 0; t < n_threads; t++)
+            for(c = 0; c < n_cs; c++)
+                for(w = 0; w < n_think; w++) {
+                    cs_loops = cs[c];
+                    think_loops = think[w];
+                    check(run(threads[t], msecs, results), close);
+                }
+    if(results)
+        fclose(results);
+    return 0;
+usage:
+    printf("Usage: bench_locks [-t threads] [-c cs_loops] "
+            "[-w think_loops] [-d msecs] [-o results_file]\n");
+close:
+    if(results)
+        fclose(results);
+    return 1;
+}
@@ -0,0 +1,159 @@
+/*
+ * bench_profit - Cashier throughput against the profit counter.
+ *
+ * Runs 1..max_cashiers cashier threads, each taking a number of
+ * payments: a short busy loop (the payment itself) followed by adding
+ * the order cost to a shared profit total. The total is kept in turn
+ * by a mutex-guarded integer (the original count_t), an atomic count_t
+ * and a shard_count_t. Payments per second should scale with the
+ * number of cashiers only as far as the counter allows, which takes
+ * a CPU per cashier to see; with only one CPU online, the speedups say
+ * nothing about the counters, and a warning is printed first.
+ *
+ * Usage: ./bench_profit [max_cashiers] [payments] [pay_loops]
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "count.h"
+#include "shard_count.h"
+#include "addict.h"
+#include "check.h"
+
+enum
+{
+    PROFIT_MUTEX,
+    PROFIT_ATOMIC,
+    PROFIT_SHARDED,
+    PROFIT_TYPES
+};
+
+static const char *profit_names[PROFIT_TYPES] = {
+    "mutex", "atomic", "sharded"
+};
+
+static int type;                        /* Counter under test */
+static long payments = 1000000;         /* Payments per cashier */
+static int pay_loops = 64;              /* Busy loop per payment */
+
+static struct {
+    pthread_mutex_t mutex;
+    long val;
+} mutex_profit = { PTHREAD_MUTEX_INITIALIZER, 0 };
+static COUNT(atomic_profit);
+static SHARD_COUNT(sharded_profit);
+
+/* Body of a cashier thread. */
+static void *cashier(void *arg)
+{
+    long i;
+    volatile int cnt;
+
+    for(i = 0; i < payments; i++) {
+        for(cnt = 0; cnt < pay_loops; cnt++) {};
+        switch(type) {
+            case PROFIT_MUTEX:
+                pthread_mutex_lock(&mutex_profit.mutex);
+                mutex_profit.val += ACOST_SIMPLE;
+                pthread_mutex_unlock(&mutex_profit.mutex);
+                break;
+            case PROFIT_ATOMIC:
+                count_inc(atomic_profit, ACOST_SIMPLE);
+                break;
+            default:
+                shard_count_add(&sharded_profit, ACOST_SIMPLE);
+        }
+    }
+    return NULL;
+}
+
+/* Returns the profit recorded by the counter under test. */
+static long profit(void)
+{
+    switch(type) {
+        case PROFIT_MUTEX:
+            return mutex_profit.val;
+        case PROFIT_ATOMIC:
+            return count_read(atomic_profit);
+        default:
+            return shard_count_sum(&sharded_profit);
+    }
+}
+
+/* 
+ * Time n cashiers taking their payments.
+ *
+ * Returns the number of payments per second, or -1 on failure.
+ */
+static double run(int n)
+{
+    int i;
+    double secs, ret = -1;
+    struct timespec start, end;
+    pthread_t *threads = malloc(n * sizeof(pthread_t));
+    check(!threads, out);
+
+    mutex_profit.val = 0;
+    count_set(atomic_profit, 0);
+    shard_count_clear(&sharded_profit);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < n; i++)
+        check(pthread_create(&threads[i], NULL, cashier, NULL), join);
+join:
+    n = i;
+    for(i = 0; i < n; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    check_pr(profit() != (long)n * payments * ACOST_SIMPLE,
+            "Profit was miscounted", free_threads);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    ret = n * payments / secs;
+free_threads:
+    free(threads);
+out:
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int n, cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_cashiers = 2 * cpus;
+    double rate, base;
+
+    if(argc > 1)
+        max_cashiers = atoi(argv[1]);
+    if(argc > 2)
+        payments = atol(argv[2]);
+    if(argc > 3)
+        pay_loops = atoi(argv[3]);
+    check_pr(max_cashiers < 1 || payments < 1, 
+            "Usage: bench_profit [max_cashiers] [payments] [pay_loops]",
+            out);
+
+    printf("# %d CPUs online\n", cpus);
+    if(cpus < 2)
+        printf("# Cashiers share one CPU, so no counter can scale here\n");
+    printf("Counter\tCashiers\tPayments/s\tSpeedup\n");
+    for(type = 0; type < PROFIT_TYPES; type++) {
+        base = 0;
+        for(n = 1; n <= max_cashiers; n *= 2) {
+            rate = run(n);
+            check(rate < 0, out);
+            if(!base)
+                base = rate;
+            printf("%s\t%d\t%.0f\t%.2f\n", profit_names[type], n, rate,
+                    rate / base);
+        }
+    }
+    return 0;
+out:
+    return 1;
+}
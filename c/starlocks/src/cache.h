@@ -0,0 +1,19 @@
+/*
+ * Cache line size and alignment helpers, for keeping independently
+ * written shared data out of each other's cache lines.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#ifndef CACHELINE_SIZE
+#define CACHELINE_SIZE 64
+#endif
+
+/* Start the declared object or member on its own cache line */
+#define cacheline_aligned __attribute__((aligned(CACHELINE_SIZE)))
+
+#endif /* _CACHE_H_ */
@@ -0,0 +1,91 @@
+/*
+ * day - Everything that one day at Starlocks tallies up. See day.h.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "day.h"
+#include "addict.h"
+#include "server.h"
+#include "pipeline.h"
+#include "check.h"
+
+/*
+ * Returns a new day with room for n_customers, their addicts all
+ *  preallocated in one go, or NULL if out of memory.
+ */
+struct day *init_day(unsigned int n_customers)
+{
+    struct day *day;
+
+    check(posix_memalign((void **)&day, CACHELINE_SIZE, sizeof(*day)),
+            fail);
+    memset(day, 0, sizeof(*day));
+    day->times = malloc(n_customers * sizeof(long));
+    check(!day->times, free_day);
+    day->size = n_customers;
+    check(pool_init(&day->addicts, sizeof(struct addict), n_customers),
+            free_times);
+    return day;
+free_times:
+    free(day->times);
+free_day:
+    free(day);
+fail:
+    return NULL;
+}
+
+/* Free the day. Every customer must have left. */
+void destroy_day(struct day *day)
+{
+    pool_destroy(&day->addicts);
+    free(day->times);
+    free(day);
+}
+
+/*
+ * Hold on to the latency histograms and stats of pipeline's servers,
+ *  once the day's customers have all left.
+ */
+void day_keep_servers(struct day *day, struct pipeline *pipeline)
+{
+    int i;
+    struct day_server *kept;
+
+    for(i = 0; i < pipeline->n_servers && day->n_servers < DAY_SERVERS;
+            i++) {
+        kept = &day->servers[day->n_servers++];
+        snprintf(kept->name, sizeof(kept->name), "%s",
+                pipeline->servers[i]->name);
+        kept->max_service = pipeline->servers[i]->max_service;
+        server_hist(pipeline->servers[i], &kept->hist);
+        server_stats(pipeline->servers[i], &kept->stats);
+    }
+}
+
+/*
+ * Merge the day's turnaround histograms over every shard into simple
+ *  and complex. Racy while customers are leaving, but never blocks
+ *  them, so it may also take a live snapshot.
+ */
+void day_hists(struct day *day, hist_t *simple, hist_t *complex)
+{
+    int i;
+
+    init_hist(simple);
+    init_hist(complex);
+    for(i = 0; i < DAY_SHARDS; i++) {
+        hist_merge(simple, &day->shards[i].simple_hist);
+        hist_merge(complex, &day->shards[i].complex_hist);
+    }
+}
+
+/* Returns the profit taken so far, in cents. */
+long day_profit(struct day *day)
+{
+    return shard_count_sum(&day->profit);
+}
@@ -0,0 +1,79 @@
+/*
+ * day - Everything that one day at Starlocks tallies up.
+ *
+ * A day owns its customers' addict pool, the latch that the last
+ * customer out signals, the profit taken and every customer's
+ * turnaround time, per order type and per server, along with what
+ * each server counted of its customers. The histograms are recorded
+ * into per CPU shards, like the servers' stats, and merged once the
+ * day is over. Each addict points back at the day it belongs to, so
+ * any number of days may run at once in one process without sharing
+ * any of it.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _DAY_H_
+#define _DAY_H_
+
+#include "cache.h"
+#include "count.h"
+#include "latch.h"
+#include "shard_count.h"
+#include "hist.h"
+#include "pool.h"
+#include "server.h"
+
+#define DAY_SERVERS     8       /* Server histograms kept */
+
+#ifndef DAY_SHARDS
+#define DAY_SHARDS      16
+#endif
+
+struct pipeline;
+
+struct day_server {
+    char name[32];
+    int max_service;            /* Service points */
+    hist_t hist;                /* Turnaround at the server, in nsecs */
+    struct server_stats stats;  /* Summed over its shards */
+};
+
+/* A CPU's share of the turnaround histograms, see day_hists() */
+struct day_shard {
+    hist_t simple_hist;         /* Turnaround, in nsecs */
+    hist_t complex_hist;
+} cacheline_aligned;
+
+struct day {
+    shard_count_t profit;       /* In cents */
+    latch_t running cacheline_aligned; /* Customers still in the store */
+    count_t simple_count;       /* Simple customers served */
+    count_t complex_count;
+    long *times;                /* In nsecs, see addict_done() */
+    unsigned int size;          /* Customers the times have room for */
+    struct day_shard shards[DAY_SHARDS]; /* Recorded into by CPU */
+    hist_t simple_hist;         /* Merged from the shards at the end */
+    hist_t complex_hist;
+    pool_t addicts;             /* Every addict of the day */
+    int n_servers;
+    struct day_server servers[DAY_SERVERS];
+} cacheline_aligned;
+
+struct day *init_day(unsigned int n_customers);
+void destroy_day(struct day *);
+void day_keep_servers(struct day *, struct pipeline *);
+void day_hists(struct day *, hist_t *simple, hist_t *complex);
+long day_profit(struct day *);
+
+/* Histogram shard that the calling thread should record into */
+static inline struct day_shard *day_shard_mine(struct day *day)
+{
+    int cpu = sched_getcpu();
+    if(cpu < 0)
+        cpu = 0;
+    return &day->shards[cpu % DAY_SHARDS];
+}
+
+#endif /* _DAY_H_ */
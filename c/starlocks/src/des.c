@@ -0,0 +1,168 @@
+/*
+ * des - Discrete-event simulation of a day at Starlocks.
+ *
+ * The events are customers walking in and service completions, kept
+ * in a binary heap ordered by virtual time (in busy-loop iterations,
+ * see LOOP_NS). Arrivals at a stage are handled on the spot: the
+ * customer takes a free service point at its server if there is one,
+ * or joins the back of the server's line. When a customer leaves a
+ * service point, the point goes straight to the front of that line, so
+ * service points are granted in arrival order exactly as with the FIFO
+ * lock.
+ *
+ * Each thread has its own event list and clock.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include "des.h"
+#include "server.h"
+#include "heap.h"
+#include "timer.h"
+#include "check.h"
+#include "pipeline.h"
+
+static __thread heap_t events;                  /* Pending events */
+static __thread unsigned long now;              /* Virtual clock */
+
+/* 
+ * Start the addict's service at their current stage, scheduling its
+ *  completion.
+ *
+ * Returns 0 on success. If the event list is out of memory, the
+ *  customer is lost, and 1 is returned; they still hold their service
+ *  point, which the caller must hand on with des_leave().
+ */
+static int des_start(struct addict *addict)
+{
+    addict->seated = des_clock();
+    check(heap_push(&events, now + stage_time(addict->stage, addict),
+            addict), lost);
+    return 0;
+lost:
+    addict_lost(addict);
+    return 1;
+}
+
+/* 
+ * Free a service point at server, handing it to the next customer in
+ *  line, and on down the line for as long as they are lost.
+ *
+ * Returns 0 on success and 1 if any customer was lost.
+ */
+static int des_leave(struct server *server)
+{
+    int ret = 0;
+    struct addict *next;
+
+    for(;;) {
+        server->present--;
+        next = server->des.front;
+        if(!next) {
+            server->des.free++;
+            return ret;
+        }
+        server->des.front = next->link;
+        if(!server->des.front)
+            server->des.back = NULL;
+        if(!des_start(next))
+            return ret;
+        ret = 1;
+    }
+}
+
+/*
+ * Bring the addict to the stage they are bound for at the current time,
+ *  or to whichever alternative it dispatches them to.
+ *
+ * Returns 0 on success and 1 if any customer was lost.
+ */
+static int des_enter(struct addict *addict)
+{
+    struct server *server;
+
+    addict->stage = stage_dispatch(addict->stage, addict);
+    server = addict->stage->server;
+
+    addict->arrived = des_clock();
+    addict->locked = addict->arrived;   /* Simulated lines take no lock */
+    server_arrive(server, addict->arrived);
+    if(server->des.free > 0) {
+        server->des.free--;
+        return des_start(addict) ? des_leave(server) | 1 : 0;
+    }
+
+    addict->link = NULL;
+    if(server->des.back)
+        server->des.back->link = addict;
+    else
+        server->des.front = addict;
+    server->des.back = addict;
+    return 0;
+}
+
+/*
+ * Arrival events carry their addict with the low bit set; addicts are
+ *  cache line aligned, so it is otherwise always clear.
+ */
+#define DES_ARRIVAL     1ul
+
+/* 
+ * Schedule a new customer's arrival at their entry stage at their due
+ *  time.
+ *
+ * Returns 0 on success and 1 on failure, when the addict is still the
+ *  caller's to lose.
+ */
+int des_arrive(struct addict *addict)
+{
+    return heap_push(&events, addict->due,
+            (void *)((unsigned long)addict | DES_ARRIVAL));
+}
+
+/* 
+ * Process service completions in time order until every customer has
+ *  left, recording each turnaround with addict_done().
+ *
+ * Returns 0 on success, or 1 if the event list ran out of memory. Each
+ *  customer that could not be scheduled is lost with addict_lost(), so
+ *  every customer leaves either way.
+ */
+int des_run(void)
+{
+    int ret = 0;
+    void *event;
+    struct addict *addict;
+    struct stage *stage;
+
+    while((event = heap_pop(&events, &now))) {
+        addict = (struct addict *)((unsigned long)event & ~DES_ARRIVAL);
+        if(addict != event) {
+            ret |= des_enter(addict);
+            continue;
+        }
+
+        stage = addict->stage;
+        stage_done(stage, addict);
+        ret |= des_leave(stage->server);
+        addict->end = des_clock();
+        server_record(stage->server, addict);
+
+        addict->stage = stage_next(stage, addict);
+        if(addict->stage) {
+            ret |= des_enter(addict);
+            continue;
+        }
+        /* That was the last stage, so the customer is done */
+        addict_done(addict);
+    }
+    destroy_heap(&events);
+    return ret;
+}
+
+/* Returns the virtual clock as a timestamp, at LOOP_NS per tick. */
+stamp_t des_clock(void)
+{
+    return now * LOOP_NS;
+}
@@ -0,0 +1,24 @@
+/*
+ * des - Discrete-event simulation of a day at Starlocks.
+ *
+ * Customers walk the same servers as in the threaded modes, but
+ * nothing runs concurrently: a virtual clock jumps from one service
+ * completion to the next, so a day takes time proportional to its
+ * number of events rather than to the busy-loop service times, and
+ * its results do not depend on the machine.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _DES_H_
+#define _DES_H_
+
+#include "timer.h"
+#include "addict.h"
+
+int des_arrive(struct addict *);
+int des_run(void);
+stamp_t des_clock(void);
+
+#endif /* _DES_H_ */
@@ -0,0 +1,325 @@
+/*
+ * fiber - User-space cooperative threads in simulated time.
+ *
+ * Fiber stacks are carved out of large anonymous mappings and recycled
+ * through a free list, so spawning a fiber costs one system call per
+ * FIBER_CHUNK fibers at most, and untouched stack pages cost nothing.
+ * Each fiber's control block sits at the top of its own stack block,
+ * just above the stack itself, so a fiber that has barely run touches
+ * a single page. There are no guard pages: FIBER_STACK_SIZE must cover
+ * the deepest call chain a fiber makes.
+ *
+ * On x86-64 the context switch saves only the callee-saved registers
+ * on the outgoing stack; elsewhere it falls back to ucontext.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "fiber.h"
+#include "heap.h"
+#include "addict.h"
+#include "timer.h"
+#include "check.h"
+
+#ifndef __x86_64__
+#include <ucontext.h>
+#endif
+
+/* Stack blocks per mapping */
+#ifndef FIBER_CHUNK
+#define FIBER_CHUNK 256
+#endif
+
+/* Saved execution context */
+#ifdef __x86_64__
+typedef struct fiber_ctx {
+    void *sp;                           /* Stack pointer when switched out */
+} fiber_ctx_t;
+#else
+typedef ucontext_t fiber_ctx_t;
+#endif
+
+struct fiber {
+    fiber_ctx_t ctx;                    /* Saved context */
+    void *(*fn)(void *);                /* Body */
+    void *arg;                          /* Argument to the body */
+    struct fiber *next;                 /* Run, wait or free list link */
+    int done;                           /* Body has returned */
+} __attribute__((aligned(16)));
+
+/* Per-thread scheduler state */
+static __thread fiber_ctx_t sched_ctx;          /* fiber_run()'s context */
+static __thread struct fiber *current;          /* Running fiber */
+static __thread struct fiber *run_front;        /* Runnable fibers */
+static __thread struct fiber *run_back;
+static __thread heap_t sleepers;                /* Fibers by wake time */
+static __thread unsigned long now;              /* Virtual clock */
+static __thread unsigned long live;             /* Unfinished fibers */
+static __thread int failed;                     /* A sleep went wrong */
+static __thread struct fiber *free_fibers;      /* Recycled stacks */
+static __thread void **chunks;                  /* Stack mappings */
+static __thread unsigned long n_chunks;
+
+#ifdef __x86_64__
+/* 
+ * fiber_switch(save, load): push the callee-saved registers, store the
+ *  stack pointer in *save, then resume the context whose stack pointer
+ *  is load.
+ */
+void fiber_switch(void **save, void *load) 
+    __attribute__((visibility("hidden")));
+__asm__(
+    ".text\n"
+    ".type fiber_switch, @function\n"
+    "fiber_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size fiber_switch, .-fiber_switch\n");
+
+#define ctx_switch(from, to) fiber_switch(&(from)->sp, (to)->sp)
+#else
+#define ctx_switch(from, to) swapcontext(from, to)
+#endif
+
+/* Run the current fiber's body, then leave it for good. */
+static void fiber_entry(void)
+{
+    struct fiber *self = current;
+    self->fn(self->arg);
+    self->done = 1;
+    ctx_switch(&self->ctx, &sched_ctx);
+}
+
+/* Set up ctx to start in fiber_entry on the stack below top. */
+static void ctx_init(fiber_ctx_t *ctx, char *base, char *top)
+{
+#ifdef __x86_64__
+    void **sp = (void **)((unsigned long)top & ~15ul);
+    int i;
+
+    *--sp = NULL;                       /* fiber_entry never returns */
+    *--sp = (void *)fiber_entry;        /* Popped by fiber_switch's ret */
+    for(i = 0; i < 6; i++)
+        *--sp = NULL;                   /* Callee-saved registers */
+    ctx->sp = sp;
+#else
+    getcontext(ctx);
+    ctx->uc_stack.ss_sp = base;
+    ctx->uc_stack.ss_size = top - base;
+    ctx->uc_link = NULL;
+    makecontext(ctx, fiber_entry, 0);
+#endif
+}
+
+/* 
+ * Take a stack block off the free list, mapping a new chunk of them
+ *  if it is empty. Returns the fiber at the top of the block, or NULL.
+ */
+static struct fiber *fiber_alloc(void)
+{
+    struct fiber *fiber = NULL;
+    void **more;
+    char *chunk;
+    int i;
+
+    if(!free_fibers) {
+        more = realloc(chunks, (n_chunks + 1) * sizeof(void *));
+        check(!more, out);
+        chunks = more;
+        chunk = mmap(NULL, FIBER_CHUNK * FIBER_STACK_SIZE, 
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        check(chunk == MAP_FAILED, out);
+        chunks[n_chunks++] = chunk;
+        for(i = FIBER_CHUNK - 1; i >= 0; i--) {
+            fiber = (struct fiber *)(chunk + (i + 1) * FIBER_STACK_SIZE) - 1;
+            fiber->next = free_fibers;
+            free_fibers = fiber;
+        }
+    }
+    fiber = free_fibers;
+    free_fibers = fiber->next;
+out:
+    return fiber;
+}
+
+/* Release every stack mapping, once no fibers are left to run. */
+static void fiber_release(void)
+{
+    unsigned long i;
+    for(i = 0; i < n_chunks; i++)
+        munmap(chunks[i], FIBER_CHUNK * FIBER_STACK_SIZE);
+    free(chunks);
+    chunks = NULL;
+    n_chunks = 0;
+    free_fibers = NULL;
+}
+
+/* Append a fiber to the run queue. */
+static void fiber_ready(struct fiber *fiber)
+{
+    fiber->next = NULL;
+    if(run_back)
+        run_back->next = fiber;
+    else
+        run_front = fiber;
+    run_back = fiber;
+}
+
+/* Switch from the current fiber back to the scheduler. */
+static void fiber_block(void)
+{
+    ctx_switch(&current->ctx, &sched_ctx);
+}
+
+/* 
+ * Create a fiber that will run fn(arg) once fiber_run() is called.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int fiber_spawn(void *(*fn)(void *), void *arg)
+{
+    int ret = 1;
+    char *base;
+    struct fiber *fiber = fiber_alloc();
+    check(!fiber, out);
+
+    base = (char *)(fiber + 1) - FIBER_STACK_SIZE;
+    fiber->fn = fn;
+    fiber->arg = arg;
+    fiber->done = 0;
+    ctx_init(&fiber->ctx, base, (char *)fiber);
+    live++;
+    fiber_ready(fiber);
+    ret = 0;
+out:
+    return ret;
+}
+
+/* 
+ * Run fibers until none are runnable or sleeping, advancing the
+ *  virtual clock to the next wakeup whenever all of them are idle.
+ *
+ * Returns 0 once every fiber has finished, or 1 if some are left
+ *  blocked forever or a fiber could not sleep. Either way the thread's
+ *  scheduler is left empty for its next run, and any blocked fibers
+ *  are dropped along with their stacks.
+ */
+int fiber_run(void)
+{
+    int ret;
+    struct fiber *fiber;
+
+    for(;;) {
+        if(!run_front) {
+            if(heap_empty(&sleepers))
+                break;
+            /* Jump to the next wakeup, and wake everyone due then */
+            now = heap_min(&sleepers);
+            while(!heap_empty(&sleepers) && heap_min(&sleepers) == now)
+                fiber_ready(heap_pop(&sleepers, NULL));
+        }
+
+        fiber = run_front;
+        run_front = fiber->next;
+        if(!run_front)
+            run_back = NULL;
+
+        current = fiber;
+        ctx_switch(&sched_ctx, &fiber->ctx);
+        current = NULL;
+
+        if(fiber->done) {
+            live--;
+            fiber->next = free_fibers;
+            free_fibers = fiber;
+        }
+    }
+
+    destroy_heap(&sleepers);
+    ret = live || failed;
+    live = 0;
+    failed = 0;
+    fiber_release();
+    return ret;
+}
+
+/* Returns the running fiber, or NULL outside of any fiber. */
+struct fiber *fiber_self(void)
+{
+    return current;
+}
+
+/* Returns the virtual clock of this thread's scheduler, in ticks. */
+unsigned long fiber_now(void)
+{
+    return now;
+}
+
+/* Returns the virtual clock as a timestamp, at LOOP_NS per tick. */
+stamp_t fiber_clock(void)
+{
+    return now * LOOP_NS;
+}
+
+/*
+ * Put the current fiber to sleep for the given number of ticks. Out of
+ *  memory, the fiber carries on so that the day still drains, but the
+ *  run is marked failed and fiber_run() returns 1.
+ */
+void fiber_sleep(unsigned long ticks)
+{
+    check(heap_push(&sleepers, now + ticks, current), fail);
+    fiber_block();
+    return;
+fail:
+    failed = 1;
+}
+
+/* Take a unit of sem, queueing behind earlier waiters if none is free. */
+void fiber_sem_wait(fiber_sem_t *sem)
+{
+    if(sem->count > 0 && !sem->front) {
+        sem->count--;
+        return;
+    }
+    current->next = NULL;
+    if(sem->back)
+        sem->back->next = current;
+    else
+        sem->front = current;
+    sem->back = current;
+    /* The poster hands us its unit directly */
+    fiber_block();
+}
+
+/* Give back a unit of sem, handing it to the longest waiter if any. */
+void fiber_sem_post(fiber_sem_t *sem)
+{
+    struct fiber *fiber = sem->front;
+
+    if(!fiber) {
+        sem->count++;
+        return;
+    }
+    sem->front = fiber->next;
+    if(!sem->front)
+        sem->back = NULL;
+    fiber_ready(fiber);
+}
@@ -0,0 +1,57 @@
+/*
+ * fiber - User-space cooperative threads in simulated time.
+ *
+ * A fiber is a function running on its own small stack, scheduled by
+ * the OS thread that calls fiber_run(). Fibers only switch when they
+ * block on a fiber semaphore or sleep, so no locking is needed between
+ * fibers of the same scheduler. Sleeping advances a virtual clock
+ * (counted in busy-loop iterations, see LOOP_NS) rather than burning
+ * CPU, so a scheduler can carry millions of fibers through a simulated
+ * day.
+ *
+ * Every OS thread has its own independent scheduler.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _FIBER_H_
+#define _FIBER_H_
+
+#include "timer.h"
+
+/* Bytes of stack per fiber, including the fiber's control block */
+#ifndef FIBER_STACK_SIZE
+#define FIBER_STACK_SIZE 8192
+#endif
+
+struct fiber;
+
+/* FIFO counting semaphore for fibers */
+typedef struct fiber_sem {
+    int count;                          /* Free units */
+    struct fiber *front;                /* Longest waiting fiber */
+    struct fiber *back;                 /* Most recent waiter */
+} fiber_sem_t;
+
+/* Static initializer */
+#define FIBER_SEM_INIT(n) { n, NULL, NULL }
+
+/* Dynamic initializer */
+static inline void fiber_sem_init(fiber_sem_t *sem, int count)
+{
+    sem->count = count;
+    sem->front = NULL;
+    sem->back = NULL;
+}
+
+int fiber_spawn(void *(*fn)(void *), void *arg);
+int fiber_run(void);
+struct fiber *fiber_self(void);
+void fiber_sleep(unsigned long ticks);
+unsigned long fiber_now(void);
+stamp_t fiber_clock(void);
+void fiber_sem_wait(fiber_sem_t *);
+void fiber_sem_post(fiber_sem_t *);
+
+#endif /* _FIBER_H_ */
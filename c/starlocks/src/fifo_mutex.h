@@ -8,8 +8,21 @@
  * thread releases the mutex and thus the next thread in line is
  * the new front element). 
  *
- * Because dynamic allocation is used to maintain this queue, this
- * mutex is not suitable for use in signal handlers.
+ * By default the queue is an MCS lock whose nodes come from a small
+ * per-thread array, so acquiring the mutex never allocates and costs
+ * a single atomic swap when uncontended. A thread may hold up to
+ * FIFO_MUTEX_DEPTH FIFO mutexes at once.
+ *
+ * Building with FIFO_TICKET selects a ticket lock whose waiters sleep
+ * on the "now serving" futex word; a handoff is one atomic store and
+ * one FUTEX_WAKE.
+ *
+ * Both of these may be told to spin adaptively before parking with
+ * fifo_mutex_set_spin().
+ *
+ * Building with FIFO_QUEUE selects the original implementation, which
+ * takes a node per acquisition from the mutex's object pool and is
+ * therefore not suitable for use in signal handlers.
  *
  * James Sullivan <sullivan.james.f@gmail.com>
  * 10095183 
@@ -23,10 +36,7 @@
 #include "check.h"
 #include "queue.h"
 
-typedef struct fifo_mutex_node {
-    pthread_cond_t cond;            /* Cond for next thread to wait on*/
-    pthread_mutex_t mutex;          /* Lock for the node cond var */
-} fifo_mutex_node_t;
+#ifdef FIFO_QUEUE
 
 /* Dynamic Initializer */
 static inline int fifo_mutex_node_init(fifo_mutex_node_t *fm_node)
@@ -56,10 +66,13 @@ static int fifo_mutex_lock(fifo_mutex_t *fm)
     check(!fm, out);
 
     /* Instantiate a new node for this thread */
-    node = node_alloc(fifo_mutex_node_t);
+    node = pool_alloc(&fm->nodes);
     check(!node, out);
     new = node_data(node, fifo_mutex_node_t *);
-    fifo_mutex_node_init(new);
+    if(fifo_mutex_node_init(new)) {
+        pool_free(&fm->nodes, node);
+        goto out;
+    }
 
     /* Add it to the list */
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
@@ -71,12 +84,13 @@ static int fifo_mutex_lock(fifo_mutex_t *fm)
 
     /* Wait until we're at the front of the queue */
     pthread_mutex_lock(&new->mutex);
-    if(node->prev)
+    while(node->prev)
         pthread_cond_wait(&new->cond, &new->mutex);
     pthread_mutex_unlock(&new->mutex);
 
     /* Take the resource lock */
     pthread_mutex_lock(&fm->mutex);
+    ret = 0;
 out:
     return ret;
 }
@@ -111,7 +125,8 @@ static int fifo_mutex_unlock(fifo_mutex_t *fm)
         pthread_cond_broadcast(&next->cond);
         pthread_mutex_unlock(&next->mutex);
     }
-    free(node);
+    pool_free(&fm->nodes, node);
+    ret = 0;
 
 unlock:
     pthread_mutex_unlock(&fm->queue.mutex);
@@ -121,5 +136,98 @@ out:
     return ret;
 }
 
+#elif defined(FIFO_TICKET)
+
+/* 
+ * Take a ticket and wait until it comes up.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static int fifo_mutex_lock(fifo_mutex_t *fm)
+{
+    int ret = 1;
+    check(!fm, out);
+    ticket_lock(&fm->lock, &fm->spin);
+    ret = 0;
+out:
+    return ret;
+}
+
+/* 
+ * Serve the next ticket, waking its holder.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static int fifo_mutex_unlock(fifo_mutex_t *fm)
+{
+    int ret = 1;
+    check(!fm, out);
+    ticket_unlock(&fm->lock);
+    ret = 0;
+out:
+    return ret;
+}
+
+#else /* MCS */
+
+#ifndef FIFO_MUTEX_DEPTH
+#define FIFO_MUTEX_DEPTH 4
+#endif
+
+/* Wait nodes for the FIFO mutexes this thread is queued on or holds */
+static __thread fifo_mutex_node_t fifo_mutex_nodes[FIFO_MUTEX_DEPTH];
+
+/* 
+ * Take a free per-thread node, join the tail of the wait queue and
+ *  block until the preceding holder hands the lock over to us.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static int fifo_mutex_lock(fifo_mutex_t *fm)
+{
+    int i, ret = 1;
+    fifo_mutex_node_t *node = NULL;
+    check(!fm, out);
+
+    for(i = 0; i < FIFO_MUTEX_DEPTH; i++) {
+        if(!fifo_mutex_nodes[i].in_use) {
+            node = &fifo_mutex_nodes[i];
+            break;
+        }
+    }
+    check_pr(!node, "FIFO mutexes nested too deeply", out);
+
+    node->in_use = 1;
+    mcs_lock(&fm->lock, &node->mcs, &fm->spin);
+    fm->holder = node;
+    ret = 0;
+out:
+    return ret;
+}
+
+/* 
+ * Hand the mutex to the next-in-line task (if any) and give the
+ *  holder's node back to its thread.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static int fifo_mutex_unlock(fifo_mutex_t *fm)
+{
+    int ret = 1;
+    fifo_mutex_node_t *node;
+    check(!fm, out);
+
+    node = fm->holder;
+    check(!node, out);
+    fm->holder = NULL;
+    mcs_unlock(&fm->lock, &node->mcs);
+    node->in_use = 0;
+    ret = 0;
+out:
+    return ret;
+}
+
+#endif
+
 #endif /* _FIFO_MUTEX_H_ */
 
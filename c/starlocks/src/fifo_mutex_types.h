@@ -2,6 +2,10 @@
  * Type definitions for the FIFO Mutex. Contains only definitions 
  * relevant to external use of the FIFO Mutex.
  *
+ * The default implementation is an MCS queue lock with per-thread
+ * wait nodes. Build with FIFO_TICKET for a futex-backed ticket lock,
+ * or with FIFO_QUEUE to use the original condition variable queue.
+ *
  * James Sullivan <sullivan.james.f@gmail.com>
  * 10095183
  */ 
@@ -12,18 +16,30 @@
 #include <pthread.h>
 #include "check.h"
 #include "queue.h"
+#include "spin.h"
+
+#ifdef FIFO_QUEUE
+
+#include "pool.h"
+
+typedef struct fifo_mutex_node {
+    pthread_cond_t cond;            /* Cond for next thread to wait on*/
+    pthread_mutex_t mutex;          /* Lock for the node cond var */
+} fifo_mutex_node_t;
+
+/* Size of a queue node carrying a fifo_mutex_node_t */
+#define FIFO_MUTEX_NODE_SIZE    (sizeof(node_t) + sizeof(fifo_mutex_node_t))
 
 typedef struct fifo_mutex {
     queue_t queue;                  /* Waiting tasks */
     pthread_mutex_t mutex;          /* The actual FIFO mutex */
+    pool_t nodes;                   /* Queue nodes for waiting tasks */
 } fifo_mutex_t;
 
 /* Static Initializers */
 #define FIFO_MUTEX_INITIALIZER(name) \
-    { INIT_QUEUE_HEAD, PTHREAD_MUTEX_INITIALIZER }
-
-#define INIT_FIFO_MUTEX(name) \
-    name = FIFO_MUTEX_INITIALIZER(name)
+    { QUEUE_HEAD_INIT(name.queue), PTHREAD_MUTEX_INITIALIZER, \
+      POOL_INITIALIZER(FIFO_MUTEX_NODE_SIZE, POOL_GROW) }
 
 /* Dynamic Initializer */
 static inline int fifo_mutex_init(fifo_mutex_t *fm)
@@ -33,9 +49,115 @@ static inline int fifo_mutex_init(fifo_mutex_t *fm)
     ret = 0;
     init_queue_head(&fm->queue);
     ret = pthread_mutex_init(&fm->mutex, NULL);
+    ret |= pool_init(&fm->nodes, FIFO_MUTEX_NODE_SIZE, POOL_GROW);
 out:
     return ret;
 }
 
-#endif /* _FIFO_MUTEX_TYPES_H_ */
+/* 
+ * Release the mutex's resources. It must not be held or waited on.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static inline int fifo_mutex_destroy(fifo_mutex_t *fm)
+{
+    int ret = 1;
+    check(!fm, out);
+    ret = pthread_mutex_destroy(&fm->mutex);
+    pool_destroy(&fm->nodes);
+out:
+    return ret;
+}
+
+/* Spinning is not supported by the condition variable queue. */
+static inline int fifo_mutex_set_spin(fifo_mutex_t *fm, int enabled)
+{
+    return !fm;
+}
+
+#elif defined(FIFO_TICKET)
+
+#include "ticket_lock.h"
+
+typedef struct fifo_mutex {
+    ticket_lock_t lock;             /* Ticket dispenser and counter */
+    spin_t spin;                    /* Spin-then-park policy */
+} fifo_mutex_t;
+
+/* Static Initializers */
+#define FIFO_MUTEX_INITIALIZER(name) \
+    { TICKET_LOCK_INIT, SPIN_INIT }
+
+/* Dynamic Initializer */
+static inline int fifo_mutex_init(fifo_mutex_t *fm)
+{
+    int ret = 1;
+    check(!fm, out);
+    ret = 0;
+    ticket_lock_init(&fm->lock);
+    spin_init(&fm->spin, 0);
+out:
+    return ret;
+}
 
+#else /* MCS */
+
+#include "mcs_lock.h"
+
+typedef struct fifo_mutex_node {
+    mcs_node_t mcs;                 /* Position in the wait queue */
+    int in_use;                     /* Slot is waiting or holding */
+} fifo_mutex_node_t;
+
+typedef struct fifo_mutex {
+    mcs_lock_t lock;                /* Tail of the wait queue */
+    fifo_mutex_node_t *holder;      /* Node of the current owner */
+    spin_t spin;                    /* Spin-then-park policy */
+} fifo_mutex_t;
+
+/* Static Initializers */
+#define FIFO_MUTEX_INITIALIZER(name) \
+    { MCS_LOCK_INIT, NULL, SPIN_INIT }
+
+/* Dynamic Initializer */
+static inline int fifo_mutex_init(fifo_mutex_t *fm)
+{
+    int ret = 1;
+    check(!fm, out);
+    ret = 0;
+    mcs_lock_init(&fm->lock);
+    fm->holder = NULL;
+    spin_init(&fm->spin, 0);
+out:
+    return ret;
+}
+
+#endif
+
+#ifndef FIFO_QUEUE
+/* Nothing to release; returns 0 on success and 1 on failure. */
+static inline int fifo_mutex_destroy(fifo_mutex_t *fm)
+{
+    return !fm;
+}
+
+/* 
+ * Enable or disable adaptive spinning before waiters park.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static inline int fifo_mutex_set_spin(fifo_mutex_t *fm, int enabled)
+{
+    int ret = 1;
+    check(!fm, out);
+    ret = 0;
+    spin_init(&fm->spin, enabled);
+out:
+    return ret;
+}
+#endif
+
+#define INIT_FIFO_MUTEX(name) \
+    name = FIFO_MUTEX_INITIALIZER(name)
+
+#endif /* _FIFO_MUTEX_TYPES_H_ */
@@ -0,0 +1,48 @@
+/*
+ * Thin wrappers around the Linux futex system call.
+ *
+ * Only the process-private wait/wake operations are exposed. A waiter
+ * must always recheck its condition after futex_wait() returns, since
+ * wakeups may be spurious.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* Sleep while *uaddr still holds val. */
+static inline int futex_wait(int *uaddr, int val)
+{
+    return syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val,
+            NULL, NULL, 0);
+}
+
+/* Wake up to n threads sleeping on uaddr. */
+static inline int futex_wake(int *uaddr, int n)
+{
+    return syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, n,
+            NULL, NULL, 0);
+}
+
+/* Sleep while *uaddr still holds val, waking only for matching bits. */
+static inline int futex_wait_bitset(int *uaddr, int val, int bits)
+{
+    return syscall(SYS_futex, uaddr, FUTEX_WAIT_BITSET_PRIVATE, val,
+            NULL, NULL, bits);
+}
+
+/* Wake up to n threads sleeping on uaddr with any of the given bits. */
+static inline int futex_wake_bitset(int *uaddr, int n, int bits)
+{
+    return syscall(SYS_futex, uaddr, FUTEX_WAKE_BITSET_PRIVATE, n,
+            NULL, NULL, bits);
+}
+
+#endif /* _FUTEX_H_ */
@@ -0,0 +1,134 @@
+/*
+ * Binary min-heap of timed entries.
+ *
+ * Each entry carries a key (normally a point in simulated time) and an
+ * arbitrary payload. Entries with equal keys are removed in the order
+ * in which they were added, which keeps simulations deterministic.
+ * The heap grows on demand.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _HEAP_H_
+#define _HEAP_H_
+
+#include <stdlib.h>
+#include "check.h"
+
+typedef struct heap_entry {
+    unsigned long key;              /* Ordering key */
+    unsigned long seq;              /* Insertion order, breaks ties */
+    void *data;                     /* Payload */
+} heap_entry_t;
+
+typedef struct heap {
+    heap_entry_t *entries;          /* Implicit binary tree */
+    unsigned long count;            /* Entries in use */
+    unsigned long size;             /* Entries allocated */
+    unsigned long seq;              /* Next insertion number */
+} heap_t;
+
+/* Static initializer */
+#define HEAP_INIT { NULL, 0, 0, 0 }
+
+/* Dynamic initializer */
+static inline void init_heap(heap_t *heap)
+{
+    heap->entries = NULL;
+    heap->count = 0;
+    heap->size = 0;
+    heap->seq = 0;
+}
+
+static inline void destroy_heap(heap_t *heap)
+{
+    free(heap->entries);
+    init_heap(heap);
+}
+
+/* Returns true if the heap is empty. */
+static inline int heap_empty(heap_t *heap)
+{
+    return heap->count == 0;
+}
+
+/* Returns the smallest key in the heap, which must be nonempty. */
+static inline unsigned long heap_min(heap_t *heap)
+{
+    return heap->entries[0].key;
+}
+
+/* True if entry a must come out of the heap before entry b */
+#define heap_before(a, b) \
+    ((a)->key < (b)->key || ((a)->key == (b)->key && (a)->seq < (b)->seq))
+
+/* 
+ * Add data to the heap under the given key.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static inline int heap_push(heap_t *heap, unsigned long key, void *data)
+{
+    int ret = 1;
+    unsigned long i, parent, size;
+    heap_entry_t *entries, new;
+
+    if(heap->count == heap->size) {
+        size = heap->size ? 2 * heap->size : 64;
+        entries = realloc(heap->entries, size * sizeof(heap_entry_t));
+        check(!entries, out);
+        heap->entries = entries;
+        heap->size = size;
+    }
+
+    new.key = key;
+    new.seq = heap->seq++;
+    new.data = data;
+
+    /* Sift the new entry up from the bottom */
+    for(i = heap->count++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if(!heap_before(&new, &heap->entries[parent]))
+            break;
+        heap->entries[i] = heap->entries[parent];
+    }
+    heap->entries[i] = new;
+    ret = 0;
+out:
+    return ret;
+}
+
+/* 
+ * Remove the entry with the smallest key, storing the key in *key if
+ *  key is non-NULL.
+ *
+ * Returns the entry's data, or NULL if the heap is empty.
+ */
+static inline void *heap_pop(heap_t *heap, unsigned long *key)
+{
+    unsigned long i, child;
+    heap_entry_t *entries = heap->entries, last;
+    void *data;
+
+    if(heap_empty(heap))
+        return NULL;
+    data = entries[0].data;
+    if(key)
+        *key = entries[0].key;
+
+    /* Sift the last entry down from the top */
+    last = entries[--heap->count];
+    for(i = 0; (child = 2 * i + 1) < heap->count; i = child) {
+        if(child + 1 < heap->count && 
+                heap_before(&entries[child + 1], &entries[child]))
+            child++;
+        if(!heap_before(&entries[child], &last))
+            break;
+        entries[i] = entries[child];
+    }
+    entries[i] = last;
+    return data;
+}
+
+#endif /* _HEAP_H_ */
@@ -0,0 +1,140 @@
+/*
+ * Log-linear latency histogram, in the style of HdrHistogram.
+ *
+ * Values below HIST_SUB are counted exactly. Above that, every power
+ * of two is split into HIST_SUB / 2 equal buckets, so any recorded
+ * value is known to within 1/64th (about 1.6%) of itself, the whole
+ * range of an unsigned long fits in a fixed 30 KB, and two histograms
+ * merge by adding their buckets.
+ *
+ * Recording is a relaxed atomic increment and never blocks, so any
+ * number of threads may record into the same histogram; reading it is
+ * only meaningful once they have finished.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _HIST_H_
+#define _HIST_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#define HIST_SUB_BITS   7
+#define HIST_SUB        (1ul << HIST_SUB_BITS)  /* Exact values */
+#define HIST_HALF       (HIST_SUB / 2)          /* Buckets per power */
+#define HIST_BUCKETS \
+    (HIST_SUB + (64 - HIST_SUB_BITS) * HIST_HALF)
+
+typedef struct hist {
+    unsigned long count;                /* Values recorded */
+    unsigned long max;                  /* Largest value recorded */
+    unsigned long sum;                  /* Of the values recorded */
+    unsigned long buckets[HIST_BUCKETS];
+} hist_t;
+
+/* Dynamic initializer */
+static inline void init_hist(hist_t *hist)
+{
+    memset(hist, 0, sizeof(hist_t));
+}
+
+/* Index of the bucket that counts value */
+static inline unsigned int hist_index(unsigned long value)
+{
+    unsigned int shift;
+    if(value < HIST_SUB)
+        return value;
+    /* Shift the value down to HIST_SUB_BITS significant bits */
+    shift = 63 - __builtin_clzl(value) - (HIST_SUB_BITS - 1);
+    return HIST_SUB + (shift - 1) * HIST_HALF 
+        + ((value >> shift) - HIST_HALF);
+}
+
+/* Largest value counted by the bucket at index */
+static inline unsigned long hist_highest(unsigned int index)
+{
+    unsigned int shift;
+    unsigned long sub;
+    if(index < HIST_SUB)
+        return index;
+    shift = (index - HIST_SUB) / HIST_HALF + 1;
+    sub = (index - HIST_SUB) % HIST_HALF + HIST_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+/* Smallest value counted by the bucket at index */
+static inline unsigned long hist_lowest(unsigned int index)
+{
+    return index ? hist_highest(index - 1) + 1 : 0;
+}
+
+/* Count one occurrence of value. */
+static inline void hist_record(hist_t *hist, unsigned long value)
+{
+    unsigned long max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&hist->buckets[hist_index(value)], 1, 
+            __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, value, __ATOMIC_RELAXED);
+    while(value > max && !__atomic_compare_exchange_n(&hist->max, &max,
+                value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* Add every value counted in src to dst. */
+static inline void hist_merge(hist_t *dst, hist_t *src)
+{
+    unsigned int i;
+    for(i = 0; i < HIST_BUCKETS; i++)
+        if(src->buckets[i])
+            dst->buckets[i] += src->buckets[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if(src->max > dst->max)
+        dst->max = src->max;
+}
+
+/* Returns the exact mean of the recorded values, or 0 if there are none. */
+static inline double hist_mean(hist_t *hist)
+{
+    return hist->count ? (double)hist->sum / hist->count : 0;
+}
+
+/* 
+ * Returns the value at or below which a fraction q (0 <= q <= 1) of the
+ *  recorded values fall, to the histogram's precision, or 0 if nothing
+ *  has been recorded.
+ */
+static inline unsigned long hist_percentile(hist_t *hist, double q)
+{
+    unsigned int i;
+    unsigned long seen = 0, rank = q * hist->count + 0.5;
+    if(!hist->count)
+        return 0;
+    if(rank < 1)
+        rank = 1;
+    for(i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if(seen >= rank)
+            break;
+    }
+    return hist_highest(i) < hist->max ? hist_highest(i) : hist->max;
+}
+
+/* 
+ * Write the nonempty buckets of the histogram to out, under a header
+ *  line naming it, as "lowest highest count" lines.
+ */
+static inline void hist_dump(hist_t *hist, const char *name, FILE *out)
+{
+    unsigned int i;
+    fprintf(out, "# %s count %lu max %lu\n", name, hist->count, hist->max);
+    for(i = 0; i < HIST_BUCKETS; i++)
+        if(hist->buckets[i])
+            fprintf(out, "%lu\t%lu\t%lu\n", hist_lowest(i), 
+                    hist_highest(i), hist->buckets[i]);
+}
+
+#endif /* _HIST_H_ */
@@ -0,0 +1,53 @@
+/* 
+ * Latch - countdown latch for "last one out wakes the waiter".
+ *
+ * The latch counts outstanding tasks. Adding and finishing tasks are
+ * single atomic operations; only the task that brings the count to
+ * zero makes a system call, to wake whoever sleeps in latch_wait().
+ * Releases by finishing tasks are visible to the waiter once it
+ * returns.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _LATCH_H_
+#define _LATCH_H_
+
+#include "futex.h"
+
+typedef struct latch {
+    int count;                      /* Outstanding tasks, futex word */
+} latch_t;
+
+#define LATCH_INIT(name) { 0 }
+
+#define LATCH(name) latch_t name = LATCH_INIT(name)
+
+static inline void INIT_LATCH(latch_t *latch)
+{
+    latch->count = 0;
+}
+
+/* Add n outstanding tasks. */
+static inline void latch_add(latch_t *latch, int n)
+{
+    __atomic_add_fetch(&latch->count, n, __ATOMIC_RELAXED);
+}
+
+/* Finish n tasks; the last one out wakes the waiters. */
+static inline void latch_done(latch_t *latch, int n)
+{
+    if(__atomic_sub_fetch(&latch->count, n, __ATOMIC_ACQ_REL) == 0)
+        futex_wake(&latch->count, INT_MAX);
+}
+
+/* Block until every outstanding task has finished. */
+static inline void latch_wait(latch_t *latch)
+{
+    int count;
+    while((count = __atomic_load_n(&latch->count, __ATOMIC_ACQUIRE)) > 0)
+        futex_wait(&latch->count, count);
+}
+
+#endif /* _LATCH_H_ */
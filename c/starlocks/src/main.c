@@ -4,338 +4,241 @@
  *
  * Simulates the throughput of customers through the Starlocks system
  *  with the given parameters, writing to STDOUT the average wait time
- *  for each given customer type (simple or complex, selected from a
- *  normal distribution). The profit is also computed and written to 
- *  STDOUT.
+ *  for each given customer type (simple or complex). Each customer's
+ *  class, and so their type, is picked uniformly at random by class
+ *  weight, or with -m (--mix) so that the given share of customers are
+ *  simple. The profit is also computed and written to STDOUT.
  *
  * Usage: ./starlocks num_customers -b num_baristas [-c num_cashiers]
- *          [-s num_selfserves] [-q]
+ *          [-s num_selfserves] [-w num_workers | -f | --des] [-a] [-B]
+ *          [-q] [-H hist_file] [-M metrics_name]
  *
+ * With -w, customers are carried through the store by a fixed pool of
+ *  worker threads (one per CPU if num_workers is 0) instead of each
+ *  getting a thread of their own. With -f, every customer is a fiber
+ *  on the main thread instead, and service times pass in virtual time
+ *  (LOOP_NS nanoseconds per busy-loop iteration), which allows days
+ *  of millions of customers. With --des (or -d), the day is a
+ *  discrete-event simulation on the same virtual clock, which gives
+ *  deterministic turnaround times in a fraction of the time.
+ *
+ * ./starlocks sweep runs many days side by side instead, for every
+ *  combination of the given numbers of customers, self services,
+ *  baristas and cashiers, and writes the turnaround statistics over
+ *  their trials as a results.dat (see sweep.h).
+ *
+ * Turnaround percentiles are printed per customer type and per server
+ *  from log-linear histograms; -H (--hist) also dumps the histograms
+ *  to the given file for offline comparison.
+ *
+ * With -M (--metrics), the day publishes live metrics to the named
+ *  shared memory segment as it runs, for ./starlocks_watch to follow.
+ *
+ * With -a, waiters on the FIFO locks and service points spin for an
+ *  adaptive number of iterations before they park. With -B (--batch),
+ *  customers enter service points through a batched FIFO admission
+ *  instead of the entry lock (see admit.h). -B is experimental: it
+ *  has not been shown to beat the entry lock.
  *
  * James Sullivan <sullivan.james.f@gmail.com>
  * 10095183
  */
 
 
-#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/time.h>
-#include <errno.h>
-#include "server.h"
-#include "addict.h"
+#include <getopt.h>
+#include <pthread.h>
 #include "starlocks.h"
+#include "sim_day.h"
+#include "sweep.h"
 #include "check.h"
-#include "count.h"
-
-/* Get rid of the insane default stack size for the customers */
-#ifndef THREAD_STACK_SIZE
-#define THREAD_STACK_SIZE 65536 
-#endif
+#include "timer.h"
 
 /* Static definitions for global data */
-COUNT(running_threads);
-COUNT(gl_profit);
-COUNT(simple_count);
-COUNT(complex_count);
-long *simple_times = NULL;
-long *complex_times = NULL;
 int quiet = 0;
+int adaptive_spin = 0;
+int batch_admit = 0;
+FILE *hist_out = NULL;  /* Histogram dump file */
+
+/* Timestamps taken to measure what one costs */
+#define TIMER_COST_STAMPS 100000
+
+static struct option long_opts[] = {
+    { "des",    no_argument,        NULL,   'd' },
+    { "hist",   required_argument,  NULL,   'H' },
+    { "layout", required_argument,  NULL,   'l' },
+    { "dispatch", required_argument, NULL,  'D' },
+    { "arrivals", required_argument, NULL,  'A' },
+    { "mix",    required_argument,  NULL,   'm' },
+    { "replay", required_argument,  NULL,   'T' },
+    { "record", required_argument,  NULL,   'R' },
+    { "seed",   required_argument,  NULL,   'S' },
+    { "metrics", required_argument, NULL,   'M' },
+    { "batch",  no_argument,        NULL,   'B' },
+    { NULL,     0,              NULL,   0 }
+};
 
-/* Returns the sum of every long in the list. */
-static inline long sum_list(long *list, int count)
+static inline void print_usage(char *name)
 {
-    int i;
-    long total = 0;
-    for(i = 0; i < count; i++) {
-        total += list[i];
-    }
-    return total;
+    printf("Usage: %s num_customers [-s num_selfserve] "
+            "[-b num_barista] [-c num_cashier] "
+            "[-l layout_file] [-D fixed|jsq|p2c|steal] "
+            "[-A arrivals] [-m simple_share] "
+            "[-T replay_trace] [-R record_trace] [-S seed] "
+            "[-M metrics_name] "
+            "[-w num_workers | -f | --des] [-a] [-B] [-q] "
+            "[-H hist_file]\n"
+            "       %s sweep customers [sweep options]\n",name,name);
 }
 
-static inline long min_list(long *list, int count)
+static inline void print_profit(int profit)
 {
-    int i;
-    long min = 999999;
-    for(i = 0; i < count; i++) {
-        min = list[i] < min ? list[i] : min;
-    }
-    return min;
+    int cents, dollars;  
+    cents = profit % 100;
+    dollars = profit / 100;
+    printf("Profit:\t$ %d.%02d\n",dollars,cents);
 }
 
-static inline long max_list(long *list, int count)
+/* Print a time in nanoseconds as seconds. */
+static inline void print_time(long time_ns)
 {
-    int i;
-    long max = 0;
-    for(i = 0; i < count; i++) {
-        max = list[i] > max ? list[i] : max;
-    }
-    return max;
+    printf("%ld.%09ld\n", time_ns / NSEC_PER_SEC, time_ns % NSEC_PER_SEC);
 }
 
-/* Average the count elements of the list. */
-static inline long average_list(long *list, int count)
+/* Print a time in nanoseconds as milliseconds, to the microsecond. */
+static inline void print_ms(unsigned long time_ns)
 {
-    long total = sum_list(list, count);
-    return total / count;
+    printf("\t%lu.%03lu", time_ns / NSEC_PER_MSEC,
+            time_ns % NSEC_PER_MSEC / NSEC_PER_USEC);
 }
 
 /* 
- * Computes a random number 0 <= x < n with a uniform distribution. 
- *
- * Returns the value of x or -1 on failure.
+ * Print the latency percentiles of a histogram on one line, and dump
+ *  the whole histogram if asked to.
  */
-static int rand_range(unsigned int n)
+static void print_latency(const char *name, hist_t *hist)
 {
-    long end;
-    int ret = -1;
-
-    /* If we want in the full range, just call rand() */
-    if((n-1) == RAND_MAX) {
-        ret = rand();
-        goto out;
-    }
-
-    end = RAND_MAX / n;
-    check(end <= 0, out);
-
-    /* Go until we have a value in our range */
-    while((ret = rand()) >= end); 
-
-    ret %= n;
-out:
-    return ret;
-}
-
-/* 
- * Starts a day in the regular mode of operation- one queue, n 
- * baristas. 
- */
-int start_day_classic(int n_customers, int n_barista)
-{
-    struct server *server = NULL;
-    struct addict *cur;
-    int i, rand, ret = 1;
-    pthread_attr_t attr;
-    pthread_t *threads = malloc(n_customers * sizeof(pthread_t));
-    check_pr(!threads, "Out of memory", out);
-
-    /* Instantiate the service line with n service points */
-    server = init_server(n_barista);
-    check_pr(!server, "Out of memory", free_threads);
-
-    /* Initialize the detachable attributes */
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-
-    /* Spawn customers of random type (simple, complex). */
-    srand(time(NULL));
-    for(i = 0; i < n_customers; i++) {
-        rand = rand_range(2); /* Two types to select */
-        switch(rand) {
-            case 0:
-                cur = init_addict(ATIME_SIMPLE, ACOST_SIMPLE,
-                        server, NULL);
-                break;
-            default:
-                cur = init_addict(ATIME_COMPLEX, ACOST_COMPLEX,
-                        server, NULL);
-        }
-        check_pr(!cur, "Out of memory", finish);
-        /* Start the timer */
-        gettimeofday(&cur->start, NULL);
-again:
-        /* Start the corresponding thread */
-        ret = pthread_create(&threads[i], &attr, (void *)*get_coffee, 
-                cur);
-        if(ret) {
-            if(!quiet)
-                printf("Failed to start thread %d, trying again\n",
-                        i);
-            sched_yield();
-            goto again;
-        }
-        count_inc(running_threads, 1);
-    }
-    ret = 0;
-finish:
-    /* Wait until the work for the day is done */
-    pthread_mutex_lock(&running_threads.count_mutex);
-    while(running_threads.val > 0) {
-        pthread_cond_wait(&running_threads.cond, 
-                &running_threads.count_mutex);
-    }
-    pthread_mutex_unlock(&running_threads.count_mutex);
-free_threads:
-    /* Free all of the threads */
-    free(threads);
-    if(server)
-        free(server);
-out:
-    return ret;
-}
-
-/* 
- * Starts a day in the new mode of operation- two queues, one that
- * feeds into self-service, and one that feeds into the coffee bar.
- *
- * One queue is also kept for the cashier.
- */
-int start_day_complex(int n_customers, int n_selfserve,
-        int n_barista, int n_cashier)
-{
-    struct server *server = NULL, *selfserve = NULL, *cashier = NULL;
-    struct addict *cur;
-    int i, rand, ret = 1;
-    pthread_attr_t attr;
-    pthread_t *threads = malloc(n_customers * sizeof(pthread_t));
-    check_pr(!threads, "Out of memory", out);
-
-    /* Instantiate the service lines */
-    server    = init_server(n_barista);
-    selfserve = init_server(3 * n_selfserve);
-    cashier   = init_server(n_cashier);
-    check_pr((!cashier || !server || !selfserve), 
-            "Out of memory", free_threads);
-
-    /* Initialize the detachable attributes */
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-
-    /* Spawn customers of random type (simple, complex). */
-    srand(time(NULL));
-    for(i = 0; i < n_customers; i++) {
-        rand = rand_range(2); /* Two types to select */
-        switch(rand) {
-            case 0:
-                cur = init_addict(ATIME_SIMPLE, ACOST_SIMPLE,
-                        selfserve, cashier);
-                break;
-            default:
-                cur = init_addict(ATIME_COMPLEX, ACOST_COMPLEX,
-                        server, cashier);
-        }
-        check_pr(!cur, "Out of memory", finish);
-        /* Start the timer */
-        gettimeofday(&cur->start, NULL);
-again:
-        /* Start the corresponding thread */
-        ret = pthread_create(&threads[i], &attr, (void *)*get_coffee, 
-                cur);
-        if(ret) {
-            if(!quiet)
-                printf("Failed to start thread %d, trying again\n",
-                        i);
-            sched_yield();
-            goto again;
-        }
-        count_inc(running_threads, 1);
-    }
-    ret = 0;
-finish:
-    /* Wait until the work for the day is done */
-    pthread_mutex_lock(&running_threads.count_mutex);
-    while(running_threads.val > 0) {
-        pthread_cond_wait(&running_threads.cond, 
-                &running_threads.count_mutex);
-    }
-    pthread_mutex_unlock(&running_threads.count_mutex);
-free_threads:
-    /* Free all of the threads, and all of the servers */
-    free(threads);
-    if(server)
-        free(server);
-    if(selfserve)
-        free(selfserve);
-    if(cashier)
-        free(cashier);
-out:
-    return ret;
+    printf("%-14s:", name);
+    print_ms(hist_percentile(hist, 0.5));
+    print_ms(hist_percentile(hist, 0.9));
+    print_ms(hist_percentile(hist, 0.99));
+    print_ms(hist_percentile(hist, 0.999));
+    print_ms(hist->max);
+    printf("\n");
+    if(hist_out)
+        hist_dump(hist, name, hist_out);
 }
 
-/* Start the day with the given parameters. 
- *
- *  Returns the total profit at the end of the day when all customers
- *  have been served, or -1 on failure. 
+/*
+ * Print what a server counted of its customers on one line: how many
+ *  arrived, the most there at once, the time-weighted average number
+ *  there and share of its service points busy while it was open, and
+ *  the average wait for the entry lock, for a service point and time
+ *  at one, in msecs. The busiest server is the one holding the day up.
  */
-static int start_day(int n_customers, int n_selfserve,
-        int n_barista, int n_cashier)
-{
-    int ret;
-
-    count_set(gl_profit, 0);
-
-    /* 
-     * If there are no self services, start in the classic mode 
-     * and ignore the number of cashiers. Otherwise, start in complex
-     * mode. 
-     */
-    if(!n_selfserve)
-        ret = start_day_classic(n_customers, n_barista);
-    else
-        ret = start_day_complex(n_customers, n_barista, n_selfserve,
-                n_cashier);
-
-    if(ret)
-        return -ret;
-
-    /* Tally up the profits */
-    pthread_mutex_lock(&gl_profit.count_mutex);
-    ret = gl_profit.val;
-    pthread_mutex_unlock(&gl_profit.count_mutex);
-
-    return ret;
-}
-
-static inline void print_usage(char *name)
+static void print_server(struct day_server *server)
 {
-    printf("Usage: %s num_customers [-s num_selfserve] "
-            "[-b num_barista] [-c num_cashier]\n",name);
-}
-
-static inline void print_profit(int profit)
-{
-    int cents, dollars;  
-    cents = profit % 100;
-    dollars = profit / 100;
-    printf("Profit:\t$ %d.%02d\n",dollars,cents);
-}
-
-static inline void print_time(int time_microsecs)
-{
-    int seconds, milliseconds;
-    seconds = time_microsecs / 1000000;
-    milliseconds = time_microsecs % 1000000;
-    printf("%d.%06d\n",seconds,milliseconds);
+    struct server_stats *stats = &server->stats;
+    unsigned long open = stats->last - stats->first;
+    unsigned long n = stats->arrivals ? stats->arrivals : 1;
+
+    printf("%-14s:\t%lu\t%lu", server->name, stats->arrivals, stats->peak);
+    printf("\t%.2f\t%.1f%%", open ? (double)server->hist.sum / open : 0,
+            open ? 100.0 * stats->service / open / server->max_service : 0);
+    print_ms(stats->lock_wait / n);
+    print_ms(stats->slot_wait / n);
+    print_ms(stats->service / n);
+    printf("\n");
 }
 
 int main(int argc, char **argv)
 {
-    unsigned int num_customers;
-    unsigned int num_selfserve = 0, num_barista = 0, num_cashier = 0; 
-    int opt, ret = -1, profit;
-    long avg_simple, avg_complex;
+    int i, opt, ret = -1;
+    int n_workers = -1, use_fibers = 0, use_des = 0, seeded = 0;
+    const char *dispatch_name = "fixed";
+    struct sim_config config = SIM_CONFIG_INIT;
+    struct sim_results results;
+    struct sim_day *sim = NULL;
 
     if(argc < 2) {
         print_usage(argv[0]);
         goto out;
     }
-    num_customers = atoi(argv[1]);
-    check_pr(!num_customers, "Need at least one customer", out);
-
-
-    while((opt = getopt(argc, argv, "s:b:c:q")) != -1)
+    /* Many days at once, see sweep.h */
+    if(!strcmp(argv[1], "sweep"))
+        exit(sweep_main(argc - 1, argv + 1));
+    config.customers = atoi(argv[1]);
+    check_pr(!config.customers, "Need at least one customer", out);
+
+    while((opt = getopt_long(argc, argv, "s:b:c:w:fdH:l:D:A:m:T:R:S:M:aBq",
+                    long_opts, NULL)) != -1)
     {
         switch(opt) {
             case 's': 
-                num_selfserve = atoi(optarg);
+                config.selfserve = atoi(optarg);
                 break;
             case 'b':
-                num_barista = atoi(optarg);
+                config.barista = atoi(optarg);
                 break;
             case 'c':
-                num_cashier = atoi(optarg);
+                config.cashier = atoi(optarg);
+                break;
+            case 'w':
+                n_workers = atoi(optarg);
+                if(n_workers < 0)
+                    n_workers = 0;
+                break;
+            case 'f':
+                use_fibers = 1;
+                break;
+            case 'd':
+                use_des = 1;
+                break;
+            case 'H':
+                hist_out = fopen(optarg, "w");
+                check_pr(!hist_out, "Cannot open histogram file", out);
+                break;
+            case 'l':
+                config.layout = optarg;
+                break;
+            case 'D':
+                config.dispatch = dispatch_policy(optarg);
+                check_pr(config.dispatch < 0, "Unknown dispatch policy",
+                        out);
+                dispatch_name = optarg;
+                break;
+            case 'A':
+                config.arrivals = optarg;
+                break;
+            case 'm':
+                config.mix = atof(optarg);
+                check_pr(config.mix < 0 || config.mix > 1,
+                        "The mix must be between 0 and 1", out);
+                break;
+            case 'T':
+                config.replay = trace_open(optarg);
+                check_pr(!config.replay, "Cannot read trace file", out);
+                break;
+            case 'R':
+                config.record = trace_create(optarg);
+                check_pr(!config.record, "Cannot create trace file", out);
+                break;
+            case 'S':
+                config.seed = strtoull(optarg, NULL, 0);
+                seeded = 1;
+                break;
+            case 'M':
+                config.metrics = optarg;
+                break;
+            case 'a':
+                adaptive_spin = 1;
+                break;
+            case 'B':
+                batch_admit = 1;
                 break;
             case 'q':
                 quiet = 1;
@@ -346,61 +249,107 @@ int main(int argc, char **argv)
         }
     }
 
-    if(quiet) {
-        check(!num_barista, out);
-    } else {
-        check_pr(!num_barista, "Need at least one barista", out);
+    /* A layout file describes its own servers */
+    if(!config.layout && quiet) {
+        check(!config.barista, out);
+    } else if(!config.layout) {
+        check_pr(!config.barista, "Need at least one barista", out);
     }
 
-    if(num_selfserve) {
+    if(!config.layout && config.selfserve) {
         if(quiet) {
-            check(!num_cashier, out);
+            check(!config.cashier, out);
         } else {
-            check_pr(!num_cashier, "Need at least one cashier", out);
+            check_pr(!config.cashier, "Need at least one cashier", out);
         }
     }
 
-    if(!quiet)
+    if(!quiet && config.layout)
+        printf( "Customers     :\t%d\n"
+                "Layout        :\t%s\n"
+                "Waiting       :\t%s\n",
+                config.customers, config.layout,
+                adaptive_spin ? "spin-then-park" : "park");
+    else if(!quiet)
         printf( "Customers     :\t%d\n"
                 "Self Services :\t%d\n"
                 "Baristas      :\t%d\n"
-                "Cashiers      :\t%d\n", 
-                num_customers, num_selfserve, 
-                num_barista, num_cashier);
-
-    /* Allocate room for our list of times */
-    simple_times = malloc(sizeof(long) * num_customers);
-    check(!simple_times, free_times);
-    complex_times = malloc(sizeof(long) * num_customers);
-    check(!complex_times, free_times);
+                "Cashiers      :\t%d\n"
+                "Waiting       :\t%s\n", 
+                config.customers, config.selfserve, 
+                config.barista, config.cashier,
+                adaptive_spin ? "spin-then-park" : "park");
+    if(use_des)
+        config.mode = SIM_DES;
+    else if(use_fibers)
+        config.mode = SIM_FIBERS;
+    else if(n_workers >= 0)
+        config.mode = SIM_WORKERS;
+    config.workers = n_workers;
+    config.quiet = quiet;
+    if(!quiet && config.dispatch != DISPATCH_FIXED)
+        printf("Dispatch      :\t%s\n", dispatch_name);
+    /* Simulated customers queue in virtual time, in order anyway */
+    if(!quiet && batch_admit && config.mode != SIM_FIBERS &&
+            config.mode != SIM_DES)
+        printf("Admission     :\tbatched (experimental)\n");
+    if(!quiet && config.arrivals)
+        printf("Arrivals      :\t%s\n", config.arrivals);
+    if(!quiet && config.metrics)
+        printf("Metrics       :\t/dev/shm/%s\n", config.metrics[0] == '/' ?
+                config.metrics + 1 : config.metrics);
+    if(!quiet && config.mix >= 0)
+        printf("Mix           :\t%.0f%% simple orders\n", 100 * config.mix);
+    if(!quiet && config.mode == SIM_FIBERS)
+        printf("Fibers        :\tvirtual time\n");
+    if(!quiet && config.mode == SIM_DES)
+        printf("Discrete-event:\tvirtual time\n");
+    if(!quiet && config.mode == SIM_WORKERS)
+        printf("Workers       :\t%d\n", n_workers ? n_workers :
+                (int)sysconf(_SC_NPROCESSORS_ONLN));
+    /* Customers in real time are timed on the monotonic clock */
+    if(!quiet && config.mode != SIM_FIBERS && config.mode != SIM_DES)
+        printf("Clock         :\tmonotonic, %lu ns per timestamp\n",
+                timer_cost(TIMER_COST_STAMPS));
+
+    if(!seeded)
+        config.seed = time(NULL);
+    if(!quiet)
+        printf("Seed          :\t%llu\n", (unsigned long long)config.seed);
 
-    profit = start_day(num_customers,
-            num_selfserve, num_barista, num_cashier);
-    check_pr(profit < 0, 
+    sim = sim_day_create(&config);
+    check(!sim, close);
+    check_pr(sim_day_run(sim), 
                 "Simulation Aborted (Out of resources).",
-                out);
-    print_profit(profit);
-    /* Compute the average turnaround time for each customer type */
-    if(simple_count.val > 0)
-        avg_simple = average_list(simple_times, simple_count.val);
-    else
-        avg_simple = 0l;
-    if(complex_count.val > 0)
-        avg_complex = average_list(complex_times, complex_count.val);
-    else
-        avg_complex = 0l;
+                destroy);
+    sim_day_results(sim, &results);
+    print_profit(results.profit);
     printf("Avg Simple :\t");
-    print_time(avg_simple);
+    print_time(results.simple_avg);
     printf("Avg Complex:\t");
-    print_time(avg_complex);
+    print_time(results.complex_avg);
+
+    /* Latency percentiles per customer type, then per server */
+    printf("Latency (ms)  :\tp50\tp90\tp99\tp99.9\tmax\n");
+    print_latency("simple", results.simple_hist);
+    print_latency("complex", results.complex_hist);
+    for(i = 0; i < results.n_servers; i++)
+        print_latency(results.servers[i].name, &results.servers[i].hist);
+    printf("Servers       :\tarrived\tpeak\tdepth\tbusy"
+            "\tlock ms\tslot ms\tserve ms\n");
+    for(i = 0; i < results.n_servers; i++)
+        print_server(&results.servers[i]);
 
     ret = 0;
-free_times:
-    if(complex_times)
-        free(complex_times);
-    if(simple_times)
-        free(simple_times);
+destroy:
+    sim_day_destroy(sim);
+close:
+    if(hist_out)
+        fclose(hist_out);
+    if(config.replay)
+        trace_close(config.replay);
+    if(config.record && trace_close(config.record))
+        printf("ERROR: Cannot write trace\n");
 out:
     pthread_exit(&ret);
 }
-
@@ -0,0 +1,113 @@
+/*
+ * MCS queue lock.
+ *
+ * Each contending thread supplies its own queue node, which is linked
+ * onto the tail of the lock with a single atomic swap. A waiter sleeps
+ * on the futex word in its own node, and the releasing thread hands
+ * the lock directly to its successor, so the lock is granted in strict
+ * arrival order and no shared cache line is hammered while waiting.
+ *
+ * The node must stay valid from mcs_lock() until the matching
+ * mcs_unlock() returns. No memory is allocated by the lock itself.
+ *
+ * A waiter may first spin on its node under an adaptive spin policy;
+ * it only announces that it is parked (and so needs a FUTEX_WAKE) once
+ * the spin limit runs out.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _MCS_LOCK_H_
+#define _MCS_LOCK_H_
+
+#include <sched.h>
+#include "futex.h"
+#include "spin.h"
+
+typedef struct mcs_node {
+    struct mcs_node *next;          /* Next waiter in line */
+    int locked;                     /* Futex word, see MCS_* states */
+} mcs_node_t;
+
+/* Node states */
+enum
+{
+    MCS_GRANTED,                    /* Lock handed over */
+    MCS_WAITING,                    /* Queued and spinning */
+    MCS_PARKED                      /* Queued and asleep on the futex */
+};
+
+typedef struct mcs_lock {
+    mcs_node_t *tail;               /* Last waiter, NULL if free */
+} mcs_lock_t;
+
+/* Static initializer */
+#define MCS_LOCK_INIT { NULL }
+
+/* Dynamic initializer */
+static inline void mcs_lock_init(mcs_lock_t *lock)
+{
+    lock->tail = NULL;
+}
+
+/*
+ * Enqueue node on the lock and block until it reaches the front,
+ * spinning first under the given policy (which may be NULL).
+ * The uncontended path is a single atomic exchange.
+ */
+static inline void mcs_lock(mcs_lock_t *lock, mcs_node_t *node,
+        spin_t *spin)
+{
+    mcs_node_t *prev;
+    int cnt, limit, state = MCS_WAITING;
+
+    node->next = NULL;
+    node->locked = MCS_WAITING;
+    prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    if(!prev)
+        return;
+
+    /* Link in behind our predecessor and wait for the handoff */
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+    limit = spin_limit(spin);
+    for(cnt = 0; cnt < limit; cnt++) {
+        if(__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE) == MCS_GRANTED)
+            break;
+        cpu_relax();
+    }
+    spin_update(spin, cnt);
+
+    if(!__atomic_compare_exchange_n(&node->locked, &state, MCS_PARKED, 0,
+                __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        return;
+    while(__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE) != MCS_GRANTED)
+        futex_wait(&node->locked, MCS_PARKED);
+}
+
+/*
+ * Release the lock held through node, handing it to the next waiter
+ * if there is one.
+ */
+static inline void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    mcs_node_t *next, *expect = node;
+
+    next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if(!next) {
+        /* Nobody behind us, so try to mark the lock free */
+        if(__atomic_compare_exchange_n(&lock->tail, &expect, NULL, 0,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+        /* A successor has swapped in but not linked itself yet */
+        while(!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+            sched_yield();
+    }
+
+    /* Only a parked successor needs the system call */
+    if(__atomic_exchange_n(&next->locked, MCS_GRANTED, __ATOMIC_RELEASE)
+            == MCS_PARKED)
+        futex_wake(&next->locked, 1);
+}
+
+#endif /* _MCS_LOCK_H_ */
@@ -0,0 +1,174 @@
+/*
+ * metrics - Publishing a running day's metrics. See metrics.h.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include "metrics.h"
+#include "day.h"
+#include "pipeline.h"
+#include "check.h"
+
+struct metrics_pub {
+    struct metrics *seg;                /* The mapped segment */
+    struct day *day;                    /* Day to take snapshots of */
+    struct pipeline *pipeline;          /* Its store */
+    int started;                        /* The thread is running */
+    int stop;                           /* Tells the thread to stop */
+    pthread_t thread;
+};
+
+/*
+ * Copy a snapshot of the day into the segment, under its sequence
+ *  count, merging the histograms and arrivals only every
+ *  METRICS_HIST_EVERY snapshots and once the day is done. Only the
+ *  publisher's thread writes the segment.
+ */
+static void metrics_publish(struct metrics_pub *pub, int done)
+{
+    int i, merge = done || !(pub->seg->snapshots % METRICS_HIST_EVERY);
+    struct metrics *seg = pub->seg;
+    struct day *day = pub->day;
+    struct server *server;
+    struct server_stats stats;
+    unsigned long seq = seg->seq;
+
+    __atomic_store_n(&seg->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    seg->stamp = timer_now();
+    seg->finished = count_read(day->simple_count) +
+        count_read(day->complex_count);
+    /* Whoever is still in the store has been sent in, too */
+    seg->spawned = seg->finished +
+        __atomic_load_n(&day->running.count, __ATOMIC_RELAXED);
+    seg->profit = day_profit(day);
+    for(i = 0; i < seg->n_servers; i++) {
+        server = pub->pipeline->servers[i];
+        seg->servers[i].present = __atomic_load_n(&server->present,
+                __ATOMIC_RELAXED);
+        if(merge) {
+            server_stats(server, &stats);
+            seg->servers[i].arrivals = stats.arrivals;
+        }
+    }
+    if(merge) {
+        seg->hist_stamp = seg->stamp;
+        day_hists(day, &seg->simple_hist, &seg->complex_hist);
+    }
+    seg->snapshots++;
+    seg->done = done;
+
+    __atomic_store_n(&seg->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Take a snapshot every METRICS_INTERVAL_US until told to stop. */
+static void *metrics_thread(void *arg)
+{
+    struct metrics_pub *pub = arg;
+    struct timespec wake;
+    stamp_t next = timer_now();
+
+    while(!__atomic_load_n(&pub->stop, __ATOMIC_ACQUIRE)) {
+        metrics_publish(pub, 0);
+        next += METRICS_INTERVAL_US * NSEC_PER_USEC;
+        timer_timespec(next, &wake);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL)
+                == EINTR);
+    }
+    return NULL;
+}
+
+/*
+ * Create the named segment for a day's metrics, replacing any segment
+ *  of that name, and describe the day and its store in it.
+ *
+ * Returns the publisher, or NULL on failure.
+ */
+struct metrics_pub *metrics_create(const char *name, struct day *day,
+        struct pipeline *pipeline, unsigned int customers)
+{
+    int i, fd;
+    char path[METRICS_NAME];
+    struct metrics_pub *pub;
+    struct metrics *seg;
+
+    check_pr(metrics_path(name, path, sizeof(path)), "Bad metrics name",
+            fail);
+    pub = calloc(1, sizeof(*pub));
+    check_pr(!pub, "Out of memory", fail);
+
+    /* Readers of an old segment keep it until they unmap it */
+    shm_unlink(path);
+    fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    check_pr(fd < 0, "Cannot create metrics segment", free_pub);
+    check_pr(ftruncate(fd, sizeof(*seg)), "Cannot size metrics segment",
+            unlink);
+    seg = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+    check_pr(seg == MAP_FAILED, "Cannot map metrics segment", unlink);
+    close(fd);
+
+    /* The segment starts out zeroed */
+    seg->magic = METRICS_MAGIC;
+    seg->version = METRICS_VERSION;
+    seg->size = sizeof(*seg);
+    seg->pid = getpid();
+    seg->customers = customers;
+    seg->n_servers = pipeline->n_servers < METRICS_SERVERS ?
+        pipeline->n_servers : METRICS_SERVERS;
+    for(i = 0; i < seg->n_servers; i++) {
+        snprintf(seg->servers[i].name, sizeof(seg->servers[i].name), "%s",
+                pipeline->servers[i]->name);
+        seg->servers[i].max_service = pipeline->servers[i]->max_service;
+    }
+    pub->seg = seg;
+    pub->day = day;
+    pub->pipeline = pipeline;
+    return pub;
+unlink:
+    close(fd);
+    shm_unlink(path);
+free_pub:
+    free(pub);
+fail:
+    return NULL;
+}
+
+/*
+ * Start publishing, as the day starts.
+ *
+ * Returns 0 on success and 1 if the thread could not be started.
+ */
+int metrics_start(struct metrics_pub *pub)
+{
+    pub->seg->started = timer_now();
+    pub->stop = 0;
+    check(pthread_create(&pub->thread, NULL, metrics_thread, pub), fail);
+    pub->started = 1;
+    return 0;
+fail:
+    return 1;
+}
+
+/* Stop publishing, with a last snapshot that marks the day done. */
+void metrics_stop(struct metrics_pub *pub)
+{
+    if(pub->started) {
+        __atomic_store_n(&pub->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(pub->thread, NULL);
+        pub->started = 0;
+    }
+    metrics_publish(pub, 1);
+}
+
+/* Unmap the segment, which stays behind for its readers. */
+void metrics_destroy(struct metrics_pub *pub)
+{
+    munmap(pub->seg, sizeof(*pub->seg));
+    free(pub);
+}
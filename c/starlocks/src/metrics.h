@@ -0,0 +1,173 @@
+/*
+ * metrics - Live metrics of a running day, in shared memory.
+ *
+ * A day given a metrics name (-M, see main.c) maps a segment of that
+ * name in /dev/shm and has a thread of its own copy a snapshot of the
+ * day into it every METRICS_INTERVAL_US: customers sent in and gone,
+ * profit so far and how many are at each server. The turnaround
+ * histograms and the servers' arrivals are merged from the shards that
+ * customers record into, which pulls in many of their cache lines, so
+ * they are only refreshed every METRICS_HIST_EVERY snapshots, and in
+ * the last. The customers never touch the segment, so publishing costs
+ * them nothing but the snapshot's reads of what they write.
+ *
+ * Snapshots are written under a sequence count, which is odd while one
+ * is being written. metrics_read() copies a snapshot out and retries
+ * if the count moved, so any number of readers may poll as often as
+ * they like without ever holding up the writer; see starlocks_watch.c.
+ *
+ * The segment outlives the day, its last snapshot marked done, until
+ * the next day of the same name replaces it or it is removed from
+ * /dev/shm. Readers tell a segment left behind from a live one by
+ * whether its pid still runs.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hist.h"
+#include "timer.h"
+
+#define METRICS_MAGIC   0x4d544c53      /* "SLTM" */
+#define METRICS_VERSION 2
+#define METRICS_SERVERS 8               /* Servers published */
+#define METRICS_NAME    64              /* Longest segment name */
+#define METRICS_RETRIES 100             /* Reads before giving up */
+
+#ifndef METRICS_INTERVAL_US
+#define METRICS_INTERVAL_US 1000        /* Between snapshots */
+#endif
+
+#ifndef METRICS_HIST_EVERY
+#define METRICS_HIST_EVERY  100         /* Snapshots per histogram merge */
+#endif
+
+struct metrics_server {
+    char name[32];
+    int max_service;                    /* Service points */
+    int present;                        /* Waiting or served */
+    unsigned long arrivals;             /* Customers so far, at hist_stamp */
+};
+
+struct metrics {
+    uint32_t magic;                     /* METRICS_MAGIC */
+    uint32_t version;                   /* METRICS_VERSION */
+    uint32_t size;                      /* sizeof(struct metrics) */
+    int32_t pid;                        /* Of the day's process */
+    unsigned long seq;                  /* Odd while being written */
+
+    /* The snapshot */
+    int done;                           /* The day is over */
+    unsigned int customers;             /* Due today */
+    stamp_t started;                    /* Day start, timer_now() */
+    stamp_t stamp;                      /* Of the snapshot */
+    unsigned long snapshots;            /* Taken so far */
+    unsigned long spawned;              /* Customers sent in */
+    unsigned long finished;             /* Customers gone */
+    long profit;                        /* In cents */
+    int n_servers;
+    struct metrics_server servers[METRICS_SERVERS];
+    stamp_t hist_stamp;                 /* Of the histograms and arrivals */
+    hist_t simple_hist;                 /* Turnaround, in nsecs */
+    hist_t complex_hist;
+};
+
+/*
+ * Write the path of the named segment into path, which has room for
+ *  len bytes. Names are those of files in /dev/shm, with or without a
+ *  leading slash.
+ *
+ * Returns 0 on success and 1 if the name is empty or too long.
+ */
+static inline int metrics_path(const char *name, char *path, size_t len)
+{
+    if(*name == '/')
+        name++;
+    if(!*name || strchr(name, '/'))
+        return 1;
+    return (size_t)snprintf(path, len, "/%s", name) >= len;
+}
+
+/*
+ * Map the named segment for reading.
+ *
+ * Returns the segment, or NULL if there is none of this version.
+ */
+static inline const struct metrics *metrics_open(const char *name)
+{
+    int fd;
+    char path[METRICS_NAME];
+    struct metrics *seg;
+
+    if(metrics_path(name, path, sizeof(path)))
+        return NULL;
+    fd = shm_open(path, O_RDONLY, 0);
+    if(fd < 0)
+        return NULL;
+    seg = mmap(NULL, sizeof(*seg), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(seg == MAP_FAILED)
+        return NULL;
+    if(seg->magic != METRICS_MAGIC || seg->version != METRICS_VERSION ||
+            seg->size != sizeof(*seg)) {
+        munmap(seg, sizeof(*seg));
+        return NULL;
+    }
+    return seg;
+}
+
+/* Unmap a segment mapped by metrics_open(). */
+static inline void metrics_close(const struct metrics *seg)
+{
+    munmap((void *)seg, sizeof(*seg));
+}
+
+/*
+ * Copy the segment's latest snapshot into snap, retrying while the
+ *  writer is in the middle of one. Yields before each retry, in case
+ *  the writer is waiting for this CPU.
+ *
+ * Returns 0 on success and 1 if no whole snapshot could be read.
+ */
+static inline int metrics_read(const struct metrics *seg,
+        struct metrics *snap)
+{
+    int i;
+    unsigned long seq;
+
+    for(i = 0; i < METRICS_RETRIES; i++) {
+        if(i)
+            sched_yield();
+        seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+        if(seq & 1)
+            continue;
+        memcpy(snap, seg, sizeof(*snap));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == seq)
+            return 0;
+    }
+    return 1;
+}
+
+struct day;
+struct pipeline;
+struct metrics_pub;
+
+struct metrics_pub *metrics_create(const char *name, struct day *,
+        struct pipeline *, unsigned int customers);
+int metrics_start(struct metrics_pub *);
+void metrics_stop(struct metrics_pub *);
+void metrics_destroy(struct metrics_pub *);
+
+#endif /* _METRICS_H_ */
@@ -0,0 +1,629 @@
+/*
+ * pipeline - Layout of the store as a graph of service stages.
+ *
+ * Builds the store layouts that customers walk through in get_coffee()
+ * and the discrete-event engine: the two original layouts, or any
+ * other read from a layout file (see pipeline_load()).
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "pipeline.h"
+#include "check.h"
+#include "shard_count.h"
+#include "day.h"
+
+#define PIPELINE_LINE   128     /* Longest line of a layout file */
+
+/* Returns a new, empty pipeline, or NULL if out of memory. */
+struct pipeline *init_pipeline(void)
+{
+    return calloc(1, sizeof(struct pipeline));
+}
+
+/* Release the pipeline along with all of its servers. */
+void destroy_pipeline(struct pipeline *pipeline)
+{
+    int i;
+
+    for(i = 0; i < pipeline->n_servers; i++)
+        destroy_server(pipeline->servers[i]);
+    for(i = 0; i < pipeline->n_names; i++)
+        free(pipeline->names[i]);
+    free(pipeline);
+}
+
+/*
+ * Add a server with max_service service points to the pipeline.
+ *
+ * Returns the server, or NULL on failure.
+ */
+struct server *pipeline_server(struct pipeline *pipeline, const char *name,
+        unsigned int max_service)
+{
+    struct server *server = NULL;
+    check(pipeline->n_servers == PIPELINE_SERVERS, out);
+
+    server = init_server(name, max_service);
+    check(!server, out);
+    pipeline->servers[pipeline->n_servers++] = server;
+out:
+    return server;
+}
+
+/*
+ * Add a stage to the pipeline, at which customers queue for server
+ *  and are served for loops iterations plus the given work.
+ *
+ * Returns the stage, or NULL on failure.
+ */
+struct stage *pipeline_stage(struct pipeline *pipeline, const char *name,
+        struct server *server, unsigned int work, unsigned int loops)
+{
+    struct stage *stage = NULL;
+    check(!server || pipeline->n_stages == PIPELINE_STAGES, out);
+
+    stage = &pipeline->stages[pipeline->n_stages++];
+    stage->name = name;
+    stage->server = server;
+    stage->work = work;
+    stage->loops = loops;
+    stage->n_routes = 0;
+    stage->dispatch = DISPATCH_FIXED;
+    stage->n_alts = 0;
+out:
+    return stage;
+}
+
+/*
+ * Send customers leaving stage from on to stage to with probability
+ *  prob.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int pipeline_route(struct stage *from, struct stage *to, double prob)
+{
+    int ret = 1;
+    check(!from || !to || from->n_routes == STAGE_ROUTES, out);
+    check(prob <= 0 || prob > 1, out);
+
+    from->routes[from->n_routes].stage = to;
+    from->routes[from->n_routes].prob = prob;
+    from->n_routes++;
+    ret = 0;
+out:
+    return ret;
+}
+
+/*
+ * Let customers bound for stage be sent to alt instead, when the
+ *  stage's dispatch policy prefers it.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int pipeline_alt(struct stage *stage, struct stage *alt)
+{
+    int ret = 1;
+    check(!stage || !alt || stage == alt, out);
+    check(stage->n_alts == STAGE_ALTS, out);
+
+    stage->alts[stage->n_alts++] = alt;
+    ret = 0;
+out:
+    return ret;
+}
+
+/* Dispatch customers among every stage's alternatives by policy. */
+void pipeline_dispatch(struct pipeline *pipeline, int policy)
+{
+    int i;
+
+    for(i = 0; i < pipeline->n_stages; i++)
+        pipeline->stages[i].dispatch = policy;
+}
+
+static const char *dispatch_names[DISPATCH_POLICIES] = {
+    "fixed", "jsq", "p2c", "steal"
+};
+
+/* Returns the DISPATCH_* policy of the given name, or -1. */
+int dispatch_policy(const char *name)
+{
+    int i;
+
+    for(i = 0; i < DISPATCH_POLICIES; i++)
+        if(!strcmp(dispatch_names[i], name))
+            return i;
+    return -1;
+}
+
+/*
+ * Add a class of customers of the given type who enter at stage entry,
+ *  weight being their share of the day relative to the other classes.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int pipeline_class(struct pipeline *pipeline, int type, double weight,
+        struct stage *entry)
+{
+    int ret = 1;
+    struct customer_class *class;
+    check(!entry || weight <= 0, out);
+    check(pipeline->n_classes == PIPELINE_CLASSES, out);
+
+    class = &pipeline->classes[pipeline->n_classes++];
+    class->type = type;
+    class->weight = weight;
+    class->entry = entry;
+    pipeline->total_weight += weight;
+    ret = 0;
+out:
+    return ret;
+}
+
+/*
+ * Reweigh the pipeline's classes so that a share simple of the day's
+ *  customers have simple orders, keeping the proportions among the
+ *  classes of each type.
+ *
+ * Returns 0 on success, or 1 if the pipeline has no class of a type
+ *  that is asked for.
+ */
+int pipeline_mix(struct pipeline *pipeline, double simple)
+{
+    int i, ret = 1;
+    double simple_weight = 0, complex_weight = 0;
+    struct customer_class *class;
+    check(simple < 0 || simple > 1, out);
+
+    for(i = 0; i < pipeline->n_classes; i++) {
+        class = &pipeline->classes[i];
+        if(class->type == ATYPE_SIMPLE)
+            simple_weight += class->weight;
+        else
+            complex_weight += class->weight;
+    }
+    check((simple > 0 && !simple_weight) ||
+            (simple < 1 && !complex_weight), out);
+
+    for(i = 0; i < pipeline->n_classes; i++) {
+        class = &pipeline->classes[i];
+        if(class->type == ATYPE_SIMPLE)
+            class->weight *= simple / simple_weight;
+        else
+            class->weight *= (1 - simple) / complex_weight;
+    }
+    pipeline->total_weight = 1;
+    ret = 0;
+out:
+    return ret;
+}
+
+/*
+ * The classic store: one line for n_barista baristas, who take the
+ *  payment as well.
+ *
+ * Returns the pipeline, or NULL on failure.
+ */
+struct pipeline *pipeline_classic(int n_barista)
+{
+    struct pipeline *pipeline = init_pipeline();
+    struct server *server;
+    struct stage *barista;
+    check(!pipeline, out);
+
+    server = pipeline_server(pipeline, "barista", n_barista);
+    barista = pipeline_stage(pipeline, "barista", server,
+            STAGE_ORDER | STAGE_PAY, 0);
+    check(pipeline_class(pipeline, ATYPE_SIMPLE, 1, barista), fail);
+    check(pipeline_class(pipeline, ATYPE_COMPLEX, 1, barista), fail);
+out:
+    return pipeline;
+fail:
+    destroy_pipeline(pipeline);
+    return NULL;
+}
+
+/*
+ * The complex store: simple orders go to n_selfserve self-service
+ *  stations of three pots each, complex ones to n_barista baristas, and
+ *  everyone then pays at one of n_cashier cashiers. Baristas can also
+ *  make simple orders, if the dispatch policy sends them any.
+ *
+ * Returns the pipeline, or NULL on failure.
+ */
+struct pipeline *pipeline_complex(int n_selfserve, int n_barista,
+        int n_cashier)
+{
+    struct pipeline *pipeline = init_pipeline();
+    struct server *bar_server, *self_server, *cash_server;
+    struct stage *barista, *selfserve, *cashier;
+    check(!pipeline, out);
+
+    bar_server  = pipeline_server(pipeline, "barista", n_barista);
+    self_server = pipeline_server(pipeline, "selfserve", 3 * n_selfserve);
+    cash_server = pipeline_server(pipeline, "cashier", n_cashier);
+    barista   = pipeline_stage(pipeline, "barista", bar_server,
+            STAGE_ORDER, 0);
+    selfserve = pipeline_stage(pipeline, "selfserve", self_server,
+            STAGE_ORDER, 0);
+    cashier   = pipeline_stage(pipeline, "cashier", cash_server,
+            STAGE_PAY, 0);
+    check(pipeline_route(barista, cashier, 1), fail);
+    check(pipeline_route(selfserve, cashier, 1), fail);
+    check(pipeline_alt(selfserve, barista), fail);
+    check(pipeline_class(pipeline, ATYPE_SIMPLE, 1, selfserve), fail);
+    check(pipeline_class(pipeline, ATYPE_COMPLEX, 1, barista), fail);
+out:
+    return pipeline;
+fail:
+    destroy_pipeline(pipeline);
+    return NULL;
+}
+
+/* Returns a copy of name owned by the pipeline, or NULL. */
+static const char *pipeline_name(struct pipeline *pipeline, const char *name)
+{
+    char *copy = NULL;
+    check(pipeline->n_names == PIPELINE_SERVERS + PIPELINE_STAGES, out);
+
+    copy = strdup(name);
+    check(!copy, out);
+    pipeline->names[pipeline->n_names++] = copy;
+out:
+    return copy;
+}
+
+/* Returns the pipeline's server of the given name, or NULL. */
+static struct server *find_server(struct pipeline *pipeline, const char *name)
+{
+    int i;
+
+    for(i = 0; i < pipeline->n_servers; i++)
+        if(!strcmp(pipeline->servers[i]->name, name))
+            return pipeline->servers[i];
+    return NULL;
+}
+
+/* Returns the pipeline's stage of the given name, or NULL. */
+static struct stage *find_stage(struct pipeline *pipeline, const char *name)
+{
+    int i;
+
+    for(i = 0; i < pipeline->n_stages; i++)
+        if(!strcmp(pipeline->stages[i].name, name))
+            return &pipeline->stages[i];
+    return NULL;
+}
+
+/* Parse the work done at a stage: order, pay, order+pay or -. */
+static int parse_work(const char *work, unsigned int *flags)
+{
+    *flags = 0;
+    if(!strcmp(work, "-"))
+        return 0;
+    if(!strcmp(work, "order") || !strcmp(work, "order+pay"))
+        *flags |= STAGE_ORDER;
+    if(!strcmp(work, "pay") || !strcmp(work, "order+pay"))
+        *flags |= STAGE_PAY;
+    return !*flags;
+}
+
+/*
+ * Parse a whole decimal count of at least min, and at most INT_MAX,
+ *  into n. Returns 0 on success.
+ */
+static int parse_count(const char *count, long min, unsigned int *n)
+{
+    char *end;
+    long val;
+
+    errno = 0;
+    val = strtol(count, &end, 10);
+    if(errno || end == count || *end || val < min || val > INT_MAX)
+        return 1;
+    *n = val;
+    return 0;
+}
+
+/* Parse a customer class's order type: simple or complex. */
+static int parse_type(const char *type, int *atype)
+{
+    if(!strcmp(type, "simple"))
+        *atype = ATYPE_SIMPLE;
+    else if(!strcmp(type, "complex"))
+        *atype = ATYPE_COMPLEX;
+    else
+        return 1;
+    return 0;
+}
+
+/* Parse one line of a layout file. Returns 0 on success. */
+static int parse_line(struct pipeline *pipeline, char *line)
+{
+    char kw[32], a[32], b[32], c[32], d[32];
+    const char *name;
+    unsigned int work, count;
+    int type;
+    struct server *server;
+    int n = sscanf(line, "%31s %31s %31s %31s %31s", kw, a, b, c, d);
+
+    if(n <= 0 || kw[0] == '#')
+        return 0;
+    if(!strcmp(kw, "server") && n == 3) {
+        name = pipeline_name(pipeline, a);
+        return !name || parse_count(b, 1, &count) ||
+            !pipeline_server(pipeline, name, count);
+    }
+    if(!strcmp(kw, "stage") && n == 5) {
+        server = find_server(pipeline, b);
+        name = pipeline_name(pipeline, a);
+        return !name || parse_work(c, &work) || parse_count(d, 0, &count) ||
+            !pipeline_stage(pipeline, name, server, work, count);
+    }
+    if(!strcmp(kw, "route") && n == 4)
+        return pipeline_route(find_stage(pipeline, a),
+                find_stage(pipeline, b), atof(c));
+    if(!strcmp(kw, "alt") && n == 3)
+        return pipeline_alt(find_stage(pipeline, a), find_stage(pipeline, b));
+    if(!strcmp(kw, "class") && n == 4)
+        return parse_type(a, &type) || pipeline_class(pipeline, type,
+                atof(b), find_stage(pipeline, c));
+    return 1;
+}
+
+/* Stage states while looking for cycles */
+enum
+{
+    STAGE_UNSEEN,
+    STAGE_ON_PATH,                      /* Being walked from */
+    STAGE_DONE                          /* No cycle through it */
+};
+
+/*
+ * Walk every way out of stage, marking stages in state. A customer at
+ *  a stage may be dispatched to any of its alternatives, so the ways out
+ *  of an alternative count as ways out of the stage.
+ *
+ * Returns 1 if a customer could come back to a stage on the path.
+ */
+static int stage_cycles(struct pipeline *pipeline, struct stage *stage,
+        int *state)
+{
+    int i, *mine = &state[stage - pipeline->stages];
+
+    if(*mine == STAGE_ON_PATH)
+        return 1;
+    if(*mine == STAGE_DONE)
+        return 0;
+    *mine = STAGE_ON_PATH;
+    for(i = 0; i < stage->n_routes; i++)
+        if(stage_cycles(pipeline, stage->routes[i].stage, state))
+            return 1;
+    for(i = 0; i < stage->n_alts; i++)
+        if(stage_cycles(pipeline, stage->alts[i], state))
+            return 1;
+    *mine = STAGE_DONE;
+    return 0;
+}
+
+/*
+ * Check that the pipeline is a store customers can walk through: the
+ *  routes out of each stage add up to at most 1, and no customer can
+ *  come back to a stage they have already visited.
+ *
+ * Returns 0 if so and 1 otherwise, saying why.
+ */
+static int pipeline_check(struct pipeline *pipeline)
+{
+    int i, j, state[PIPELINE_STAGES] = { STAGE_UNSEEN };
+    double total;
+    struct stage *stage;
+
+    for(i = 0; i < pipeline->n_stages; i++) {
+        stage = &pipeline->stages[i];
+        total = 0;
+        for(j = 0; j < stage->n_routes; j++)
+            total += stage->routes[j].prob;
+        /* Allow for rounding in the probabilities as written */
+        check_pr(total > 1 + 1e-9,
+                "Layout routes out of a stage add up to more than 1", fail);
+    }
+    for(i = 0; i < pipeline->n_classes; i++)
+        check_pr(stage_cycles(pipeline, pipeline->classes[i].entry, state),
+                "Layout routes go round in a cycle", fail);
+    return 0;
+fail:
+    return 1;
+}
+
+/*
+ * Read a store layout, one declaration per line:
+ *
+ *  server <name> <service points>
+ *  stage <name> <server> <order|pay|order+pay|-> <loops>
+ *  route <from stage> <to stage> <probability>
+ *  class <simple|complex> <weight> <entry stage>
+ *  alt <stage> <alternative stage>
+ *
+ * Service points must number at least 1 and loops at least 0.
+ *  Everything must be declared before it is referred to. Blank lines
+ *  and lines starting with # are skipped. The routes must not form a
+ *  cycle, and those out of a stage must add up to at most 1.
+ *
+ * Returns the pipeline, or NULL if the layout is invalid.
+ */
+struct pipeline *pipeline_load(FILE *in)
+{
+    char line[PIPELINE_LINE];
+    int n_line = 0;
+    struct pipeline *pipeline = init_pipeline();
+    check(!pipeline, out);
+
+    while(fgets(line, sizeof(line), in)) {
+        n_line++;
+        if(parse_line(pipeline, line)) {
+            printf("ERROR: Bad layout line %d: %s", n_line, line);
+            goto fail;
+        }
+    }
+    check_pr(!pipeline->n_classes, "Layout has no customer classes", fail);
+    check(pipeline_check(pipeline), fail);
+out:
+    return pipeline;
+fail:
+    destroy_pipeline(pipeline);
+    return NULL;
+}
+
+/* Returns the index of a customer class picked with rng by weight. */
+int pipeline_pick_class(struct pipeline *pipeline, rng_t *rng)
+{
+    int i;
+    double pick = rng_double(rng) * pipeline->total_weight;
+
+    for(i = 0; i < pipeline->n_classes - 1; i++) {
+        pick -= pipeline->classes[i].weight;
+        if(pick < 0)
+            break;
+    }
+    return i;
+}
+
+/*
+ * Returns a new customer of the day of the class'th class, who picks
+ *  their routes with seed, or NULL on failure.
+ */
+struct addict *pipeline_addict(struct pipeline *pipeline, struct day *day,
+        int class, unsigned int seed)
+{
+    if(class < 0 || class >= pipeline->n_classes)
+        return NULL;
+    return init_addict(day, pipeline->classes[class].type,
+            pipeline->classes[class].entry, seed);
+}
+
+/* Returns how long the addict takes to serve at stage, in loops. */
+unsigned int stage_time(struct stage *stage, struct addict *addict)
+{
+    unsigned int time = stage->loops;
+
+    if(stage->work & STAGE_ORDER)
+        time += addict->order_time;
+    if(stage->work & STAGE_PAY)
+        time += PAY_TIME;
+    return time;
+}
+
+/* Account for the work done on the addict at stage. */
+void stage_done(struct stage *stage, struct addict *addict)
+{
+    if(stage->work & STAGE_ORDER)
+        addict->caffeinated++;
+    if(stage->work & STAGE_PAY)
+        shard_count_add(&addict->day->profit, addict->order_cost);
+}
+
+/*
+ * Pick the addict's route out of stage.
+ *
+ * Returns the next stage to visit, or NULL if the addict leaves.
+ */
+struct stage *stage_next(struct stage *stage, struct addict *addict)
+{
+    int i;
+    double pick;
+
+    if(!stage->n_routes)
+        return NULL;
+    pick = rng32_double(&addict->seed);
+    for(i = 0; i < stage->n_routes; i++) {
+        pick -= stage->routes[i].prob;
+        if(pick < 0)
+            return stage->routes[i].stage;
+    }
+    return NULL;
+}
+
+/*
+ * Returns true if a customer joining server a would have fewer people
+ *  ahead of them per service point than at server b.
+ */
+static int queue_shorter(struct server *a, struct server *b)
+{
+    long ahead_a = server_queue(a) + a->max_service;
+    long ahead_b = server_queue(b) + b->max_service;
+
+    return (ahead_a + 1) * b->max_service < (ahead_b + 1) * a->max_service;
+}
+
+/* Returns the alternative to stage with the shortest queue. */
+static struct stage *dispatch_jsq(struct stage *stage)
+{
+    int i;
+    struct stage *pick = stage;
+
+    for(i = 0; i < stage->n_alts; i++)
+        if(queue_shorter(stage->alts[i]->server, pick->server))
+            pick = stage->alts[i];
+    return pick;
+}
+
+/*
+ * Returns the shorter queue of two different alternatives to stage
+ *  (the stage itself being one of them), picked at random.
+ */
+static struct stage *dispatch_p2c(struct stage *stage,
+        struct addict *addict)
+{
+    int n = stage->n_alts + 1;
+    int a = rng32_bounded(&addict->seed, n);
+    int b = (a + 1 + rng32_bounded(&addict->seed, n - 1)) % n;
+    struct stage *first  = a ? stage->alts[a - 1] : stage;
+    struct stage *second = b ? stage->alts[b - 1] : stage;
+
+    if(queue_shorter(second->server, first->server))
+        return second;
+    return first;
+}
+
+/*
+ * Returns the stage, unless customers are waiting there and an
+ *  alternative is idle: then it steals the customer.
+ */
+static struct stage *dispatch_steal(struct stage *stage)
+{
+    int i;
+
+    if(server_queue(stage->server) < 0)
+        return stage;
+    for(i = 0; i < stage->n_alts; i++)
+        if(server_queue(stage->alts[i]->server) < 0)
+            return stage->alts[i];
+    return stage;
+}
+
+/*
+ * Pick which stage to send the addict to, bound for stage: the stage
+ *  itself or one of its alternatives, by the stage's dispatch policy.
+ */
+struct stage *stage_dispatch(struct stage *stage, struct addict *addict)
+{
+    if(!stage->n_alts)
+        return stage;
+    switch(stage->dispatch) {
+        case DISPATCH_JSQ:
+            return dispatch_jsq(stage);
+        case DISPATCH_P2C:
+            return dispatch_p2c(stage, addict);
+        case DISPATCH_STEAL:
+            return dispatch_steal(stage);
+        default:
+            return stage;
+    }
+}
@@ -0,0 +1,123 @@
+/*
+ * pipeline - Layout of the store as a graph of service stages.
+ *
+ * A stage is one visit to a server: the customer queues for one of the
+ * server's service points, is served for the stage's time and leaves.
+ * Each stage routes its customers on to up to STAGE_ROUTES further
+ * stages, picking one at random by the routes' probabilities; whatever
+ * probability is left over sends the customer out of the store. Stages
+ * may share a server, and the routes may form any acyclic graph.
+ *
+ * A stage may also name alternative stages that can do its work, such
+ * as a barista making a self-service order. Whenever a customer is
+ * bound for the stage, its dispatch policy picks which of them they
+ * go to:
+ *
+ *  fixed   Always the stage itself.
+ *  jsq     Join the shortest queue, by customers present per service
+ *          point.
+ *  p2c     Power of two choices: the shorter queue of two candidates
+ *          picked at random.
+ *  steal   The stage itself, unless its line is busy and an
+ *          alternative has an idle service point and nobody waiting,
+ *          in which case the idle server takes the customer.
+ *
+ * Each customer class names the stage its customers enter at, and how
+ * many of the day's customers belong to it.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdio.h>
+#include "addict.h"
+#include "server.h"
+#include "rng.h"
+
+#define PIPELINE_SERVERS    8   /* Servers per pipeline */
+#define PIPELINE_STAGES     16  /* Stages per pipeline */
+#define PIPELINE_CLASSES    4   /* Customer classes per pipeline */
+#define STAGE_ROUTES        4   /* Routes out of a stage */
+#define STAGE_ALTS          3   /* Alternatives to a stage */
+
+/* Work done at a stage, on top of its fixed time */
+#define STAGE_ORDER     0x1     /* Make the customer's order */
+#define STAGE_PAY       0x2     /* Take the customer's payment */
+
+/* Dispatch policies */
+enum
+{
+    DISPATCH_FIXED,
+    DISPATCH_JSQ,
+    DISPATCH_P2C,
+    DISPATCH_STEAL,
+    DISPATCH_POLICIES
+};
+
+struct stage;
+
+struct route {
+    struct stage *stage;                /* Where the route leads */
+    double prob;                        /* Chance of taking it */
+};
+
+struct stage {
+    const char *name;                   /* Name used in layouts */
+    struct server *server;              /* Service points to queue for */
+    unsigned int work;                  /* STAGE_* work done here */
+    unsigned int loops;                 /* Fixed time, in loop iterations */
+    int n_routes;
+    struct route routes[STAGE_ROUTES];  /* Ways out of the stage */
+    int dispatch;                       /* DISPATCH_* among alts */
+    int n_alts;
+    struct stage *alts[STAGE_ALTS];     /* Stages that can stand in */
+};
+
+struct customer_class {
+    int type;                           /* ATYPE_* of its customers */
+    double weight;                      /* Share of the day's customers */
+    struct stage *entry;                /* First stage visited */
+};
+
+struct pipeline {
+    int n_servers;
+    struct server *servers[PIPELINE_SERVERS];
+    int n_stages;
+    struct stage stages[PIPELINE_STAGES];
+    int n_classes;
+    struct customer_class classes[PIPELINE_CLASSES];
+    double total_weight;                /* Sum of the class weights */
+    int n_names;
+    char *names[PIPELINE_SERVERS + PIPELINE_STAGES]; /* Loaded names */
+};
+
+struct pipeline *init_pipeline(void);
+void destroy_pipeline(struct pipeline *);
+struct server *pipeline_server(struct pipeline *, const char *name,
+        unsigned int max_service);
+struct stage *pipeline_stage(struct pipeline *, const char *name,
+        struct server *server, unsigned int work, unsigned int loops);
+int pipeline_route(struct stage *from, struct stage *to, double prob);
+int pipeline_class(struct pipeline *, int type, double weight,
+        struct stage *entry);
+int pipeline_alt(struct stage *stage, struct stage *alt);
+int pipeline_mix(struct pipeline *, double simple);
+void pipeline_dispatch(struct pipeline *, int policy);
+int dispatch_policy(const char *name);
+struct pipeline *pipeline_classic(int n_barista);
+struct pipeline *pipeline_complex(int n_selfserve, int n_barista,
+        int n_cashier);
+struct pipeline *pipeline_load(FILE *);
+
+int pipeline_pick_class(struct pipeline *, rng_t *);
+struct addict *pipeline_addict(struct pipeline *, struct day *,
+        int class, unsigned int seed);
+unsigned int stage_time(struct stage *, struct addict *);
+void stage_done(struct stage *, struct addict *);
+struct stage *stage_next(struct stage *, struct addict *);
+struct stage *stage_dispatch(struct stage *, struct addict *);
+
+#endif /* _PIPELINE_H_ */
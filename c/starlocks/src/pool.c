@@ -0,0 +1,14 @@
+/*
+ * Process-wide state of the object pools. See pool.h.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include "pool.h"
+
+/* Each thread's free lists, one slot per pool generation */
+__thread pool_cache_t pool_caches[POOL_CACHES];
+
+/* Last generation handed out; every pool in the process gets its own */
+unsigned int pool_gens;
@@ -0,0 +1,250 @@
+/*
+ * Fixed-size object pool.
+ *
+ * Objects are carved out of large slabs, so a pool sized for the day
+ * up front costs one system allocation however many objects it hands
+ * out. Each thread keeps its own free list per pool, so an object
+ * freed on a different thread from the one that allocated it goes back
+ * on the freeing thread's list and is reused from there, without a
+ * lock. Threads only take the pool's lock to move POOL_BATCH objects
+ * at a time between their list and the pool's shared one, or to grow
+ * the pool by another slab when it runs dry.
+ *
+ * Objects are rounded up to whole cache lines and start on a line
+ * boundary. Their memory belongs to the pool until pool_destroy(),
+ * which releases every slab at once; objects left on the lists of
+ * threads that have exited are reclaimed then too.
+ *
+ * A thread caches objects for up to POOL_CACHES pools at once. Pools
+ * sharing a cache slot still work, but recycle each other's objects
+ * less often.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "cache.h"
+#include "check.h"
+
+#define POOL_CACHES     8       /* Pools cached per thread */
+#define POOL_BATCH      32      /* Objects moved per lock taken */
+#define POOL_GROW       64      /* Default objects per slab */
+
+/* Round size up to a whole number of cache lines */
+#define pool_size(size) \
+    (((size) + CACHELINE_SIZE - 1) & ~(size_t)(CACHELINE_SIZE - 1))
+
+typedef struct pool_obj {
+    struct pool_obj *next;          /* Next free object */
+} pool_obj_t;
+
+typedef struct pool_slab {
+    struct pool_slab *next;         /* Older slab */
+} pool_slab_t;
+
+typedef struct pool {
+    size_t size;                    /* Object size, in whole lines */
+    size_t grow;                    /* Objects per slab */
+    unsigned int gen;               /* Identifies the thread caches */
+    pthread_mutex_t lock;           /* Guards everything below */
+    pool_slab_t *slabs;             /* Every slab, newest first */
+    char *next;                     /* Unused part of the newest slab */
+    char *end;
+    pool_obj_t *free;               /* Objects given back by threads */
+} pool_t;
+
+/* A thread's free list for one pool */
+typedef struct pool_cache {
+    unsigned int gen;               /* Pool the objects belong to */
+    int count;                      /* Objects on the list */
+    pool_obj_t *free;               /* Free objects */
+} pool_cache_t;
+
+/* Shared by every pool, in pool.c */
+extern __thread pool_cache_t pool_caches[POOL_CACHES];
+extern unsigned int pool_gens;
+
+/*
+ * Static initializer, for pools of objects of the given size that grow
+ * n at a time. The first slab is allocated on first use.
+ */
+#define POOL_INITIALIZER(size, n) \
+    { pool_size(size), (n), 0, PTHREAD_MUTEX_INITIALIZER, \
+      NULL, NULL, NULL, NULL }
+
+#define POOL(name, size, n) \
+    pool_t name = POOL_INITIALIZER(size, n)
+
+/* Returns the pool's generation, giving it one on first use. */
+static inline unsigned int pool_gen(pool_t *pool)
+{
+    unsigned int gen = __atomic_load_n(&pool->gen, __ATOMIC_ACQUIRE);
+    unsigned int new;
+
+    while(!gen) {
+        new = __atomic_add_fetch(&pool_gens, 1, __ATOMIC_RELAXED);
+        if(__atomic_compare_exchange_n(&pool->gen, &gen, new, 0,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            gen = new;
+    }
+    return gen;
+}
+
+/*
+ * Returns the calling thread's free list for the pool. A list left
+ * over from another pool in the same slot is dropped; its objects are
+ * reclaimed with the slabs of the pool they belong to.
+ */
+static inline pool_cache_t *pool_cache(pool_t *pool)
+{
+    unsigned int gen = pool_gen(pool);
+    pool_cache_t *cache = &pool_caches[gen % POOL_CACHES];
+
+    if(cache->gen != gen) {
+        cache->gen = gen;
+        cache->count = 0;
+        cache->free = NULL;
+    }
+    return cache;
+}
+
+/*
+ * Add a slab of pool->grow objects. Call with the pool's lock held.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static inline int pool_grow(pool_t *pool)
+{
+    pool_slab_t *slab;
+
+    /* The slab header takes the first line, keeping objects aligned */
+    if(posix_memalign((void **)&slab, CACHELINE_SIZE,
+                CACHELINE_SIZE + pool->grow * pool->size))
+        return 1;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->next = (char *)slab + CACHELINE_SIZE;
+    pool->end = pool->next + pool->grow * pool->size;
+    return 0;
+}
+
+/*
+ * Dynamic initializer. Preallocates n objects of the given size, and
+ * grows by as many again whenever they run out.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static inline int pool_init(pool_t *pool, size_t size, size_t n)
+{
+    int ret = 1;
+    check(!pool || !size || !n, out);
+
+    pool->size = pool_size(size);
+    pool->grow = n;
+    pool->gen = 0;
+    pool->slabs = NULL;
+    pool->next = NULL;
+    pool->end = NULL;
+    pool->free = NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    ret = pool_grow(pool);
+out:
+    return ret;
+}
+
+/* Release every slab of the pool, and with them every object. */
+static inline void pool_destroy(pool_t *pool)
+{
+    pool_slab_t *slab;
+
+    while((slab = pool->slabs)) {
+        pool->slabs = slab->next;
+        free(slab);
+    }
+    pool->next = NULL;
+    pool->end = NULL;
+    pool->free = NULL;
+    /* Orphan any thread's list of the old objects */
+    pool->gen = 0;
+    pthread_mutex_destroy(&pool->lock);
+}
+
+/*
+ * Refill an empty thread free list with up to POOL_BATCH objects,
+ * from those given back to the pool first and from its slabs next.
+ *
+ * Returns 0 on success and 1 if the pool could not grow.
+ */
+static inline int pool_refill(pool_t *pool, pool_cache_t *cache)
+{
+    int ret = 0;
+    pool_obj_t *obj;
+
+    pthread_mutex_lock(&pool->lock);
+    while(cache->count < POOL_BATCH) {
+        if(pool->free) {
+            obj = pool->free;
+            pool->free = obj->next;
+        } else {
+            if(pool->next == pool->end && (cache->count ||
+                        (ret = pool_grow(pool))))
+                break;
+            obj = (pool_obj_t *)pool->next;
+            pool->next += pool->size;
+        }
+        obj->next = cache->free;
+        cache->free = obj;
+        cache->count++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return ret;
+}
+
+/* Returns a new object from the pool, or NULL if out of memory. */
+static inline void *pool_alloc(pool_t *pool)
+{
+    pool_obj_t *obj;
+    pool_cache_t *cache = pool_cache(pool);
+
+    if(!cache->free && pool_refill(pool, cache))
+        return NULL;
+    obj = cache->free;
+    cache->free = obj->next;
+    cache->count--;
+    return obj;
+}
+
+/*
+ * Give an object back to the pool it came from. Once the thread's
+ * list holds two batches, one batch moves to the pool's shared list
+ * for other threads to allocate from.
+ */
+static inline void pool_free(pool_t *pool, void *ptr)
+{
+    int i;
+    pool_obj_t *obj = ptr, *last;
+    pool_cache_t *cache = pool_cache(pool);
+
+    obj->next = cache->free;
+    cache->free = obj;
+    if(++cache->count < 2 * POOL_BATCH)
+        return;
+
+    last = obj;
+    for(i = 1; i < POOL_BATCH; i++)
+        last = last->next;
+    cache->free = last->next;
+    cache->count -= POOL_BATCH;
+
+    pthread_mutex_lock(&pool->lock);
+    last->next = pool->free;
+    pool->free = obj;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+#endif /* _POOL_H_ */
@@ -0,0 +1,147 @@
+/*
+ * Bounded lock-free multi-producer/multi-consumer ring queue.
+ *
+ * Each slot carries a sequence number that tells producers and
+ * consumers whose turn it is to use the slot, so any number of threads
+ * can add to the tail and remove from the head concurrently with one
+ * compare-and-swap each and no mutex (Vyukov's bounded MPMC queue).
+ * The head and tail counters live on separate cache lines so that
+ * producers and consumers do not contend with each other.
+ *
+ * The ring stores pointers, and holds a fixed number of them which is
+ * rounded up to a power of two when it is initialized. Elements are
+ * removed in the order in which their additions completed.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stdlib.h>
+#include "cache.h"
+#include "check.h"
+
+typedef struct ring_slot {
+    unsigned long seq;              /* Turn at which the slot is usable */
+    void *data;                     /* Stored element */
+} ring_slot_t;
+
+typedef struct ring {
+    unsigned long head cacheline_aligned;   /* Next position to remove */
+    unsigned long tail cacheline_aligned;   /* Next position to add */
+    ring_slot_t *slots cacheline_aligned;   /* Slot array */
+    unsigned long mask;                     /* Capacity - 1 */
+} ring_t;
+
+/* 
+ * Dynamic initializer. Allocates room for at least size elements.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static inline int ring_init(ring_t *ring, unsigned long size)
+{
+    int ret = 1;
+    unsigned long i, cap = 1;
+    check(!ring || !size, out);
+
+    while(cap < size)
+        cap <<= 1;
+    ring->slots = malloc(cap * sizeof(ring_slot_t));
+    check(!ring->slots, out);
+
+    for(i = 0; i < cap; i++)
+        ring->slots[i].seq = i;
+    ring->mask = cap - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ret = 0;
+out:
+    return ret;
+}
+
+/* Release the ring's slots. The ring must no longer be in use. */
+static inline void ring_destroy(ring_t *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/* 
+ * Add a new element to the end of the ring.
+ *
+ * Returns 0 on success and 1 if the ring is full.
+ */
+static inline int ring_add_tail(void *data, ring_t *ring)
+{
+    ring_slot_t *slot;
+    unsigned long pos, seq;
+    long diff;
+
+    pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    for(;;) {
+        slot = &ring->slots[pos & ring->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        diff = (long)seq - (long)pos;
+        if(diff == 0) {
+            /* The slot is free at our turn; try to claim it */
+            if(__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if(diff < 0) {
+            /* The slot still holds an element from a lap ago */
+            return 1;
+        } else {
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->data = data;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* 
+ * Remove an element from the front of the ring.
+ *
+ * Returns the element, or NULL if the ring is empty.
+ */
+static inline void *ring_remove_head(ring_t *ring)
+{
+    ring_slot_t *slot;
+    unsigned long pos, seq;
+    long diff;
+    void *data;
+
+    pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    for(;;) {
+        slot = &ring->slots[pos & ring->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        diff = (long)seq - (long)(pos + 1);
+        if(diff == 0) {
+            /* The slot has been filled for our turn; try to take it */
+            if(__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if(diff < 0) {
+            /* Nothing has been added here yet */
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    data = slot->data;
+    __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    return data;
+}
+
+/* Returns true if the ring currently holds no elements. */
+static inline int ring_empty(ring_t *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ==
+        __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+#endif /* _RING_H_ */
@@ -0,0 +1,185 @@
+/*
+ * ring_stress - Stress test of the MPMC ring queue of ring.h.
+ *
+ * Runs a number of producer threads that each add a numbered run of
+ * elements to one small ring, against 1 and then 4 consumer threads
+ * that take them off. Every element must come out exactly once, and
+ * each consumer must see every producer's elements in the order they
+ * were added. A full ring or an empty one makes the thread yield and
+ * try again, so the ring wraps many times over a run.
+ *
+ * Prints a line per run and exits with 1 if any run failed.
+ *
+ * Usage: ./ring_stress [-p producers] [-n elements] [-r ring_size]
+ *  elements is the number added by each producer.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "ring.h"
+#include "check.h"
+
+#define STRESS_PRODUCERS 64
+#define STRESS_ELEMENTS  20000
+#define STRESS_RING      256
+
+/*
+ * Elements are the producer and the element's number in its run, one
+ *  up so that none is NULL.
+ */
+#define element(producer, i) \
+    ((void *)((((unsigned long)(producer) << 32) | (i)) + 1))
+#define element_producer(e) ((((unsigned long)(e)) - 1) >> 32)
+#define element_number(e)   ((((unsigned long)(e)) - 1) & 0xffffffffu)
+
+static ring_t ring;
+static int n_producers = STRESS_PRODUCERS;
+static unsigned long n_elements = STRESS_ELEMENTS;
+static unsigned char *seen;             /* Times each element came out */
+static int producing;                   /* Producers not yet done */
+static int failed;                      /* A consumer saw it go wrong */
+
+/* Body of a producer: add its run of elements, in order. */
+static void *producer(void *arg)
+{
+    unsigned long i, id = (unsigned long)arg;
+
+    for(i = 0; i < n_elements; i++)
+        while(ring_add_tail(element(id, i), &ring)) {
+            if(__atomic_load_n(&failed, __ATOMIC_RELAXED))
+                return NULL;
+            sched_yield();
+        }
+    __atomic_sub_fetch(&producing, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ * Body of a consumer: take elements until the producers are done and
+ *  the ring is empty, or until the run has failed.
+ */
+static void *consumer(void *arg)
+{
+    void *e;
+    int done;
+    unsigned long id, i;
+    long *last = malloc(n_producers * sizeof(long));
+
+    if(!last) {
+        __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    for(id = 0; id < n_producers; id++)
+        last[id] = -1;
+
+    while(!__atomic_load_n(&failed, __ATOMIC_RELAXED)) {
+        /* Read first, so that an empty ring after it means all taken */
+        done = !__atomic_load_n(&producing, __ATOMIC_ACQUIRE);
+        if(!(e = ring_remove_head(&ring))) {
+            if(done)
+                break;
+            sched_yield();
+            continue;
+        }
+        id = element_producer(e);
+        i = element_number(e);
+        if(id >= n_producers || i >= n_elements || (long)i <= last[id]) {
+            __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        last[id] = i;
+        __atomic_add_fetch(&seen[id * n_elements + i], 1, __ATOMIC_RELAXED);
+    }
+    free(last);
+    return NULL;
+}
+
+/*
+ * Run every producer against n_consumers consumers on a fresh ring of
+ *  ring_size, and check what came out.
+ *
+ * Returns 0 if every element came out once and in order, 1 otherwise.
+ */
+static int run(int n_consumers, unsigned long ring_size)
+{
+    int i, n_threads = n_producers + n_consumers, ret = 1;
+    unsigned long e, lost = 0, doubled = 0;
+    pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+    check_pr(!threads, "Out of memory", out);
+    seen = calloc(n_producers * n_elements, 1);
+    check_pr(!seen, "Out of memory", free_threads);
+    check_pr(ring_init(&ring, ring_size), "Out of memory", free_seen);
+    producing = n_producers;
+    failed = 0;
+
+    for(i = 0; i < n_threads; i++)
+        check_pr(pthread_create(&threads[i], NULL,
+                    i < n_consumers ? consumer : producer,
+                    (void *)(unsigned long)(i - n_consumers)),
+                "Failed to start threads", join);
+join:
+    n_threads = i;
+    for(i = 0; i < n_threads; i++)
+        pthread_join(threads[i], NULL);
+    check(n_threads != n_producers + n_consumers, destroy);
+
+    for(e = 0; e < n_producers * n_elements; e++) {
+        lost += !seen[e];
+        doubled += seen[e] > 1;
+    }
+    printf("%d producers, %d consumers: %lu elements, %lu lost, "
+            "%lu duplicated, %s\n", n_producers, n_consumers,
+            n_producers * n_elements, lost, doubled,
+            failed ? "out of order" : "in order");
+    ret = lost || doubled || failed || !ring_empty(&ring);
+destroy:
+    ring_destroy(&ring);
+free_seen:
+    free(seen);
+free_threads:
+    free(threads);
+out:
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int opt, ret = 0;
+    unsigned long ring_size = STRESS_RING;
+
+    while((opt = getopt(argc, argv, "p:n:r:")) != -1) {
+        switch(opt) {
+            case 'p':
+                n_producers = atoi(optarg);
+                check_pr(n_producers < 1, "Need a producer", usage);
+                break;
+            case 'n':
+                n_elements = strtoul(optarg, NULL, 0);
+                check_pr(!n_elements || n_elements > 0xffffffffu,
+                        "Bad number of elements", usage);
+                break;
+            case 'r':
+                ring_size = strtoul(optarg, NULL, 0);
+                check_pr(!ring_size, "Need room in the ring", usage);
+                break;
+            default:
+                goto usage;
+        }
+    }
+
+    ret |= run(1, ring_size);
+    ret |= run(4, ring_size);
+    if(ret)
+        printf("FAILED\n");
+    return ret;
+usage:
+    printf("Usage: ring_stress [-p producers] [-n elements] "
+            "[-r ring_size]\n");
+    return 1;
+}
@@ -0,0 +1,127 @@
+/*
+ * rng - Seedable random number generators.
+ *
+ * rng_t is xoshiro256** (Blackman and Vigna): four words of state, a
+ * period of 2^256 - 1, and no lock, so each day or thread draws from a
+ * generator of its own. rng_seed() expands a 64 bit seed into the
+ * state with splitmix64, and rng_jump() skips 2^128 draws ahead, so a
+ * generator jumped i times gives the i'th of 2^128 non-overlapping
+ * streams from the same seed.
+ *
+ * Each customer also carries a 32 bit seed for their routes, which is
+ * all a trace records of them; rng32_next() draws from such a seed as
+ * the state of a Weyl sequence through the murmur3 finalizer.
+ *
+ * Bounded draws from a seed use Lemire's multiply-shift, which needs a
+ * division only in the rare case that a draw has to be thrown away.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _RNG_H_
+#define _RNG_H_
+
+#include <stdint.h>
+
+typedef struct rng {
+    uint64_t s[4];
+} rng_t;
+
+static inline uint64_t rng_rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/* Returns the next output of splitmix64 on state. */
+static inline uint64_t rng_splitmix(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* Seed the generator. Every seed, zero included, is a good one. */
+static inline void rng_seed(rng_t *rng, uint64_t seed)
+{
+    int i;
+    for(i = 0; i < 4; i++)
+        rng->s[i] = rng_splitmix(&seed);
+}
+
+/* Returns 64 random bits. */
+static inline uint64_t rng_next(rng_t *rng)
+{
+    uint64_t *s = rng->s;
+    uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return result;
+}
+
+/* Skip 2^128 draws ahead, to the start of the next stream. */
+static inline void rng_jump(rng_t *rng)
+{
+    static const uint64_t jump[4] = {
+        0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull,
+        0xa9582618e03fc9aaull, 0x39abdc4529b1661cull
+    };
+    uint64_t s[4] = { 0, 0, 0, 0 };
+    int i, b, j;
+
+    for(i = 0; i < 4; i++)
+        for(b = 0; b < 64; b++) {
+            if(jump[i] & (1ull << b))
+                for(j = 0; j < 4; j++)
+                    s[j] ^= rng->s[j];
+            rng_next(rng);
+        }
+    for(j = 0; j < 4; j++)
+        rng->s[j] = s[j];
+}
+
+/* Returns a uniform random number in [0, 1), with 53 random bits. */
+static inline double rng_double(rng_t *rng)
+{
+    return (rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+/* Returns the next 32 random bits from a 32 bit seed. */
+static inline uint32_t rng32_next(uint32_t *seed)
+{
+    uint32_t z = (*seed += 0x9e3779b9u);
+
+    z = (z ^ (z >> 16)) * 0x85ebca6bu;
+    z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+    return z ^ (z >> 16);
+}
+
+/* Returns a uniform random number in [0, 1) from a 32 bit seed. */
+static inline double rng32_double(uint32_t *seed)
+{
+    return rng32_next(seed) * 0x1.0p-32;
+}
+
+/* Returns a uniform random integer in [0, n) from a 32 bit seed. */
+static inline uint32_t rng32_bounded(uint32_t *seed, uint32_t n)
+{
+    uint64_t m = (uint64_t)rng32_next(seed) * n;
+    uint32_t threshold;
+
+    if((uint32_t)m < n) {
+        threshold = -n % n;
+        while((uint32_t)m < threshold)
+            m = (uint64_t)rng32_next(seed) * n;
+    }
+    return m >> 32;
+}
+
+#endif /* _RNG_H_ */
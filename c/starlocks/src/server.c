@@ -6,58 +6,302 @@
  * (in particular, a semaphore) that a fixed number of customers may
  * simultaneously enter.
  *
+ * Customers running as fibers use a fiber semaphore instead, which
+ * grants service points in arrival order, and spend their service
+ * time asleep in virtual time rather than in a busy loop.
+ *
  * James Sullivan <sullivan.james.f@gmail.com>
  * 10095183
  */
 
 #include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#include <string.h>
 #include "server.h"
 #include "check.h"
 #include "count.h"
 #include "starlocks.h"
+#include "fiber.h"
+#include "timer.h"
+#include "pipeline.h"
 #include <semaphore.h>
 
+#ifndef CHAOS
+#include "fifo_mutex.h"
+#endif
+
 /* 
  * Initialize a new server of the given type. 
  *
  * Returns 0 if the server type is invalid or there's not enough
  * memory.
  */
-struct server *init_server(unsigned int max_service)
+struct server *init_server(const char *name, unsigned int max_service)
 {
-    struct server *server = NULL;
-    check(max_service == 0, out);
-    server = malloc(sizeof(struct server));
-    check(!server, out);
+    int i;
+    struct server *server;
+    check(max_service == 0, fail);
+    check(posix_memalign((void **)&server, CACHELINE_SIZE,
+                sizeof(struct server)), fail);
 
+    server->name = name;
     server->max_service = max_service;
-    sem_init(&server->service_sem, 0, server->max_service);
+    server->present = 0;
+    /* Fails on more points than a semaphore can count */
+    check(sem_init(&server->service_sem, 0, max_service), free_server);
+    fiber_sem_init(&server->fiber_slots, server->max_service);
+    server->des.free  = server->max_service;
+    server->des.front = NULL;
+    server->des.back  = NULL;
+    memset(server->shards, 0, sizeof(server->shards));
+    for(i = 0; i < SERVER_SHARDS; i++)
+        server->shards[i].stats.first = ULONG_MAX;
+    spin_init(&server->sem_spin, adaptive_spin);
+    admit_init(&server->admit);
+    spin_init(&server->admit_spin, adaptive_spin);
     #ifndef CHAOS
     fifo_mutex_init(&server->lock);
+    fifo_mutex_set_spin(&server->lock, adaptive_spin);
     #else
-    pthread_mutex_init(&server->lock);
+    pthread_mutex_init(&server->lock, NULL);
     #endif
-out:
     return server;
+free_server:
+    free(server);
+fail:
+    return NULL;
+}
+
+/* Release a server made by init_server(). */
+void destroy_server(struct server *server)
+{
+    sem_destroy(&server->service_sem);
+    #ifndef CHAOS
+    fifo_mutex_destroy(&server->lock);
+    #else
+    pthread_mutex_destroy(&server->lock);
+    #endif
+    free(server);
 }
 
 /*
- * Serve the given addict their glorious caffeine. The time to 
- *  service the addict's request depends on their order_time value.
+ * Occupy one of the server's service points, blocking until one is
+ *  free. With adaptive spinning enabled, poll the semaphore for a
+ *  while before going to sleep on it.
  */
-inline void serve(struct addict *addict)
+void server_wait(struct server *server)
 {
-    _serve(addict); /* Busy loop for order_time times */ 
-    addict->caffeinated++;
+    int cnt, val, limit = spin_limit(&server->sem_spin);
+
+    for(cnt = 0; cnt < limit; cnt++) {
+        sem_getvalue(&server->service_sem, &val);
+        if(val > 0 && !sem_trywait(&server->service_sem)) {
+            spin_update(&server->sem_spin, cnt);
+            return;
+        }
+        cpu_relax();
+    }
+    spin_update(&server->sem_spin, cnt);
+    sem_wait(&server->service_sem);
 }
 
 /*
- * Force the addict to cough up the dough. This may take some 
- *  fixed amount of time.
+ * Enter one of the server's service points through its admit, in turn
+ *  with the other customers queued on it. At the head of the line,
+ *  wait for a point, then take every free one that a customer behind
+ *  us is waiting for and admit them along with us.
+ *
+ * There is no entry lock to wait for, so locked is stamped as we take
+ *  our ticket, and the whole wait in line counts as waiting for a point.
  */
-inline void pay(struct addict *addict)
+static void server_admit(struct server *server, struct addict *addict)
 {
-    _pay(); /* Busy wait for a fixed amount of time */
-    count_inc(gl_profit, addict->order_cost);
+    int me, n, behind;
+
+    addict->locked = timer_now();
+    if(!admit_wait(&server->admit, &me, &server->admit_spin)) {
+        /* The head took a point for us */
+        addict->seated = timer_now();
+        return;
+    }
+    server_wait(server);
+    addict->seated = timer_now();
+    behind = admit_behind(&server->admit, me);
+    for(n = 0; n < behind && !sem_trywait(&server->service_sem); n++);
+    admit_serve(&server->admit, me, n);
 }
 
+/*
+ * Enter one of the server's service points, in turn with the other
+ *  customers queued on it, through the entry lock or, with batch_admit
+ *  set, the admit. The addict's locked and seated times are
+ *  set to when they got the entry lock (or their ticket) and then a
+ *  service point.
+ */
+void server_enter(struct server *server, struct addict *addict)
+{
+    server_arrive(server, addict->arrived);
+    if(fiber_self()) {
+        /* Fibers take no lock, and wait for the point in virtual time */
+        addict->locked = addict->arrived;
+        fiber_sem_wait(&server->fiber_slots);
+        addict->seated = fiber_clock();
+        return;
+    }
+    if(batch_admit) {
+        server_admit(server, addict);
+        return;
+    }
+
+    /* 
+     * This is used for two reasons.
+     * 1) With FIFO enabled, this lock maintains the order of the
+     *  threads and atomicizes the operation of selecting a service
+     *  point.
+     * 2) Without FIFO enabled, this lock atomicizes the operation
+     *  of selecting a service point (and also incurs a similar penalty
+     *  of performance to the FIFO lock, keeping things fairish).
+     *
+     * Both timestamps are taken under the lock, so that handing it on
+     *  does not count as waiting for a service point.
+     */
+    #ifndef CHAOS
+    fifo_mutex_lock(&server->lock);
+    addict->locked = timer_now();
+    server_wait(server);
+    addict->seated = timer_now();
+    fifo_mutex_unlock(&server->lock);
+    #else
+    pthread_mutex_lock(&server->lock);
+    addict->locked = timer_now();
+    server_wait(server);
+    addict->seated = timer_now();
+    pthread_mutex_unlock(&server->lock);
+    #endif
+}
+
+/* Leave the service point taken in server_enter(). */
+void server_leave(struct server *server)
+{
+    __atomic_sub_fetch(&server->present, 1, __ATOMIC_RELAXED);
+    if(fiber_self())
+        fiber_sem_post(&server->fiber_slots);
+    else
+        sem_post(&server->service_sem);
+}
+
+/* Shard that the calling thread should count into */
+static inline struct server_shard *server_shard_mine(struct server *server)
+{
+    int cpu = sched_getcpu();
+    if(cpu < 0)
+        cpu = 0;
+    return &server->shards[cpu % SERVER_SHARDS];
+}
+
+/* Raise *stat to value, if value is larger. */
+static inline void stat_max(unsigned long *stat, unsigned long value)
+{
+    unsigned long cur = __atomic_load_n(stat, __ATOMIC_RELAXED);
+    while(value > cur && !__atomic_compare_exchange_n(stat, &cur,
+                value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* Lower *stat to value, if value is smaller. */
+static inline void stat_min(unsigned long *stat, unsigned long value)
+{
+    unsigned long cur = __atomic_load_n(stat, __ATOMIC_RELAXED);
+    while(value < cur && !__atomic_compare_exchange_n(stat, &cur,
+                value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+ * Count a customer arriving at the server at time arrived, who is now
+ *  waiting for a service point.
+ */
+void server_arrive(struct server *server, stamp_t arrived)
+{
+    struct server_stats *stats = &server_shard_mine(server)->stats;
+    int present = __atomic_add_fetch(&server->present, 1, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&stats->arrivals, 1, __ATOMIC_RELAXED);
+    stat_max(&stats->peak, present);
+    stat_min(&stats->first, arrived);
+}
+
+/*
+ * Record that the addict left the server at their end time, having
+ *  arrived, got the entry lock, got a service point and been served.
+ */
+void server_record(struct server *server, struct addict *addict)
+{
+    struct server_shard *shard = server_shard_mine(server);
+    struct server_stats *stats = &shard->stats;
+
+    hist_record(&shard->hist, timer_ns(addict->arrived, addict->end));
+    __atomic_add_fetch(&stats->lock_wait,
+            timer_ns(addict->arrived, addict->locked), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->slot_wait,
+            timer_ns(addict->locked, addict->seated), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->service,
+            timer_ns(addict->seated, addict->end), __ATOMIC_RELAXED);
+    stat_max(&stats->last, addict->end);
+}
+
+/*
+ * Sum the server's stats over every shard into stats. Only meaningful
+ *  once its customers have all left.
+ */
+void server_stats(struct server *server, struct server_stats *stats)
+{
+    int i;
+    struct server_stats *shard;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->first = ULONG_MAX;
+    for(i = 0; i < SERVER_SHARDS; i++) {
+        shard = &server->shards[i].stats;
+        stats->arrivals += shard->arrivals;
+        stats->lock_wait += shard->lock_wait;
+        stats->slot_wait += shard->slot_wait;
+        stats->service += shard->service;
+        if(shard->peak > stats->peak)
+            stats->peak = shard->peak;
+        if(shard->first < stats->first)
+            stats->first = shard->first;
+        if(shard->last > stats->last)
+            stats->last = shard->last;
+    }
+    if(!stats->arrivals)
+        stats->first = 0;
+}
+
+/*
+ * Merge the server's latency histogram over every shard into hist.
+ *  Only meaningful once its customers have all left.
+ */
+void server_hist(struct server *server, hist_t *hist)
+{
+    int i;
+
+    init_hist(hist);
+    for(i = 0; i < SERVER_SHARDS; i++)
+        hist_merge(hist, &server->shards[i].hist);
+}
+
+/*
+ * Serve the given addict their glorious caffeine, and take their money
+ *  if this is where they pay. The time to service the addict depends
+ *  on the work done at the stage they are visiting.
+ */
+void serve(struct addict *addict)
+{
+    unsigned int time = stage_time(addict->stage, addict);
+
+    if(fiber_self())
+        fiber_sleep(time);
+    else
+        _serve(time); /* Busy loop for the stage's time */ 
+    stage_done(addict->stage, addict);
+}
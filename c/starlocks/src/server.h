@@ -8,38 +8,111 @@
 
 #include "queue.h"
 #include "addict.h"
+#include "spin.h"
+#include "fiber.h"
+#include "hist.h"
+#include "cache.h"
+#include "timer.h"
+#include "admit.h"
 #include <semaphore.h>
 #ifndef CHAOS
 #include "fifo_mutex_types.h"
 #endif
 
-/* Busy loop that runs for as long as the addict's order takes. */
-#define _serve(addict)          \
+/* Busy loop that runs for the given number of iterations. */
+#define _serve(loops)           \
     do {                        \
         volatile int _cnt;      \
-        for(_cnt = 0; _cnt < addict->order_time; _cnt++) {};   \
+        for(_cnt = 0; _cnt < (loops); _cnt++) {};   \
     } while(0);
 
-/* Busy loop that runs for as long as the payment takes. */
-#define _pay(addict)            \
-    do {                        \
-        volatile int _cnt;      \
-        for(_cnt = 0; _cnt < PAY_TIME; _cnt++) {};   \
-    } while(0);
+#ifndef SERVER_SHARDS
+#define SERVER_SHARDS 16
+#endif
+
+/*
+ * What the customers of a server add up on their way through it. The
+ * waits are in nsecs, split into waiting for the entry lock and then
+ * for a service point; service is the time spent at a service point.
+ * peak is the most customers that were waiting or served at once, and
+ * first and last are the first arrival and the last departure, which
+ * bound the time the server was open.
+ */
+struct server_stats {
+    unsigned long arrivals;
+    unsigned long peak;
+    unsigned long lock_wait;
+    unsigned long slot_wait;
+    unsigned long service;
+    stamp_t first;
+    stamp_t last;
+};
+
+/* A CPU's share of the stats and histogram, see server_stats() */
+struct server_shard {
+    struct server_stats stats;
+    hist_t hist;                        /* Time spent here, in nsecs */
+} cacheline_aligned;
 
+/*
+ * Fields are grouped by who writes them, each group on its own cache
+ * line: the entry lock is written by every customer arriving and the
+ * service point semaphore by every customer served. The stats and the
+ * latency histogram, written by every customer leaving, are sharded by
+ * CPU, as with shard_count_t, so that customers never contend to count
+ * themselves, and only summed once the day is over. Allocate with
+ * init_server() so the struct itself starts on a line boundary.
+ */
 struct server { 
+    /* Read-mostly */
+    const char *name;                   /* Name used in reports */
     int max_service;                    /* Number of service points */
-    sem_t service_sem;                  /* Service point semaphore */
+    fiber_sem_t fiber_slots;            /* Service points for fibers */
+    struct {
+        int free;                       /* Idle service points */
+        struct addict *front;           /* Line of waiting customers */
+        struct addict *back;
+    } des;                              /* Discrete-event state */
+
+    /* Written on arrival */
     #ifndef CHAOS
-    fifo_mutex_t lock;                  /* Fair FIFO */
+    fifo_mutex_t lock cacheline_aligned;        /* Fair FIFO */
     #else
-    pthread_mutex_t lock;               /* MACFO entry lock */
+    pthread_mutex_t lock cacheline_aligned;     /* MACFO entry lock */
     #endif
-};
+    admit_t admit;                      /* Batched entry, see admit.h */
+    spin_t admit_spin;                  /* Spin policy for the admit */
+
+    /* Written on entry to and exit from a service point */
+    sem_t service_sem cacheline_aligned;        /* Service point semaphore */
+    spin_t sem_spin;                    /* Spin policy for the sem */
+    int present;                        /* Customers waiting or served */
+
+    /* Written on arrival and departure, by CPU */
+    struct server_shard shards[SERVER_SHARDS];
+} cacheline_aligned;
+
+/*
+ * Returns the length of the server's line, counting customers waiting
+ * for or at a service point; minus the number of idle service points
+ * if there is no line.
+ */
+static inline int server_queue(struct server *server)
+{
+    return __atomic_load_n(&server->present, __ATOMIC_RELAXED) -
+        server->max_service;
+}
 
-struct server *init_server(unsigned int max_service);
-inline void serve(struct addict *);
-inline void pay(struct addict *);
+struct server *init_server(const char *name, unsigned int max_service);
+void destroy_server(struct server *);
+void server_arrive(struct server *, stamp_t arrived);
+void server_record(struct server *, struct addict *);
+void server_stats(struct server *, struct server_stats *);
+void server_hist(struct server *, hist_t *);
+void server_wait(struct server *);
+void server_enter(struct server *, struct addict *);
+void server_leave(struct server *);
+void serve(struct addict *);
 
 #endif /* _SERVER_H_ */
 
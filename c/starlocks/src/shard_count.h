@@ -0,0 +1,69 @@
+/* 
+ * Shard Count - sharded integer total for write-heavy counters.
+ *
+ * Every CPU adds into its own cache line, so threads on different CPUs
+ * never contend, and the shards are only summed when the total is
+ * read. Additions are still atomic, since a thread may be preempted
+ * and migrated in the middle of one, and more CPUs than shards may
+ * share a slot.
+ *
+ * Needs _GNU_SOURCE for sched_getcpu().
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _SHARD_COUNT_H_
+#define _SHARD_COUNT_H_
+
+#include <sched.h>
+#include "cache.h"
+
+#ifndef COUNT_SHARDS
+#define COUNT_SHARDS 64
+#endif
+
+typedef struct count_shard {
+    long val;
+} cacheline_aligned count_shard_t;
+
+typedef struct shard_count {
+    count_shard_t shards[COUNT_SHARDS];
+} shard_count_t;
+
+#define SHARD_COUNT(name) shard_count_t name
+
+/* Shard that the calling thread should add into */
+static inline count_shard_t *shard_count_mine(shard_count_t *count)
+{
+    int cpu = sched_getcpu();
+    if(cpu < 0)
+        cpu = 0;
+    return &count->shards[cpu % COUNT_SHARDS];
+}
+
+/* Add i to the total. */
+static inline void shard_count_add(shard_count_t *count, long i)
+{
+    __atomic_add_fetch(&shard_count_mine(count)->val, i, __ATOMIC_RELAXED);
+}
+
+/* Reset the total to zero. Not safe against concurrent additions. */
+static inline void shard_count_clear(shard_count_t *count)
+{
+    int i;
+    for(i = 0; i < COUNT_SHARDS; i++)
+        __atomic_store_n(&count->shards[i].val, 0, __ATOMIC_RELAXED);
+}
+
+/* Returns the current total, summing every shard. */
+static inline long shard_count_sum(shard_count_t *count)
+{
+    int i;
+    long total = 0;
+    for(i = 0; i < COUNT_SHARDS; i++)
+        total += __atomic_load_n(&count->shards[i].val, __ATOMIC_RELAXED);
+    return total;
+}
+
+#endif /* _SHARD_COUNT_H_ */
@@ -0,0 +1,331 @@
+/*
+ * sim_day - A day at Starlocks, as a library. See sim_day.h.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include "sim_day.h"
+#include "addict.h"
+#include "workers.h"
+#include "fiber.h"
+#include "des.h"
+#include "timer.h"
+#include "check.h"
+
+/* Get rid of the insane default stack size for the customers */
+#ifndef THREAD_STACK_SIZE
+#define THREAD_STACK_SIZE 65536
+#endif
+
+/* Returns the sum of every long in the list. */
+static inline long sum_list(long *list, int count)
+{
+    int i;
+    long total = 0;
+    for(i = 0; i < count; i++) {
+        total += list[i];
+    }
+    return total;
+}
+
+/* Average the count elements of the list. */
+static inline long average_list(long *list, int count)
+{
+    long total = sum_list(list, count);
+    return total / count;
+}
+
+/*
+ * Lay out the store for the day: from the layout file if one was
+ *  given, and otherwise in the regular mode of operation (one queue, n
+ *  baristas) if there are no self services, or in the new mode (a
+ *  queue for self-service, one for the coffee bar and one for the
+ *  cashier) if there are.
+ *
+ * Returns the pipeline, or NULL on failure.
+ */
+static struct pipeline *lay_out_store(const struct sim_config *config)
+{
+    FILE *in;
+    struct pipeline *pipeline;
+
+    if(!config->layout) {
+        if(!config->selfserve)
+            return pipeline_classic(config->barista);
+        return pipeline_complex(config->selfserve, config->barista,
+                config->cashier);
+    }
+    in = fopen(config->layout, "r");
+    check_pr(!in, "Cannot open layout file", fail);
+    pipeline = pipeline_load(in);
+    fclose(in);
+    return pipeline;
+fail:
+    return NULL;
+}
+
+/*
+ * Set up a day as configured, with its store laid out and room for
+ *  all of its customers.
+ *
+ * Returns the day, or NULL on failure.
+ */
+struct sim_day *sim_day_create(const struct sim_config *config)
+{
+    unsigned int i;
+    struct sim_day *sim = malloc(sizeof(struct sim_day));
+    check_pr(!sim, "Out of memory", out);
+
+    sim->config = *config;
+    /* Room for every customer's time, and their addicts up front */
+    sim->day = init_day(config->customers);
+    check_pr(!sim->day, "Out of memory", free_sim);
+    sim->pipeline = lay_out_store(config);
+    check(!sim->pipeline, free_day);
+    check_pr(config->mix >= 0 && pipeline_mix(sim->pipeline, config->mix),
+            "Layout has no orders of a type in the mix", free_pipeline);
+    pipeline_dispatch(sim->pipeline, config->dispatch);
+    check_pr(init_arrivals(&sim->arrivals, config->arrivals),
+            "Bad arrival schedule", free_pipeline);
+    sim->metrics = NULL;
+    if(config->metrics) {
+        sim->metrics = metrics_create(config->metrics, sim->day,
+                sim->pipeline, config->customers);
+        check(!sim->metrics, free_arrivals);
+    }
+    rng_seed(&sim->rng, config->seed);
+    for(i = 0; i < config->stream; i++)
+        rng_jump(&sim->rng);
+    return sim;
+free_arrivals:
+    destroy_arrivals(&sim->arrivals);
+free_pipeline:
+    destroy_pipeline(sim->pipeline);
+free_day:
+    destroy_day(sim->day);
+free_sim:
+    free(sim);
+    sim = NULL;
+out:
+    return sim;
+}
+
+/*
+ * Start the i'th customer's timer and send them off to get their
+ *  coffee- as an arrival event in discrete-event mode, as a fiber in
+ *  fiber mode, on the worker pool if there is one, and on a detached
+ *  thread of their own otherwise.
+ *
+ * Customers of an open-loop day are due due nanoseconds after the day
+ *  started at day_start, and are timed from then. Real customers are
+ *  held back until they are due; simulated ones wait in virtual time.
+ *
+ * Returns 0 on success. On failure, returns 1 and frees the addict.
+ */
+static int send_addict(struct sim_day *sim, struct addict *cur, int i,
+        unsigned long due, stamp_t day_start,
+        struct workers *workers, pthread_attr_t *attr, pthread_t *thread)
+{
+    struct timespec wake;
+    struct day *day = cur->day;
+    int mode = sim->config.mode;
+
+    latch_add(&day->running, 1);
+    if(mode == SIM_DES || mode == SIM_FIBERS) {
+        cur->due = due / LOOP_NS;
+        cur->start = cur->due * LOOP_NS;
+        if(mode == SIM_DES ? des_arrive(cur) :
+                fiber_spawn(addict_thread, cur)) {
+            addict_lost(cur);
+            return 1;
+        }
+        return 0;
+    }
+
+    if(sim->arrivals.dist == ARRIVE_CLOSED && !sim->config.replay) {
+        cur->start = timer_now();
+    } else {
+        cur->start = day_start + due;
+        timer_timespec(cur->start, &wake);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL)
+                == EINTR);
+    }
+    if(workers) {
+        workers_submit(workers, cur);
+        return 0;
+    }
+    /* Start the corresponding thread */
+    while(pthread_create(thread, attr, addict_thread, cur)) {
+        if(!sim->config.quiet)
+            printf("Failed to start thread %d, trying again\n", i);
+        sched_yield();
+    }
+    return 0;
+}
+
+/*
+ * Make the next customer of the day: the next of the trace being replayed
+ *  if there is one, and otherwise one of random class, due on the
+ *  arrival schedule. Records them if recording.
+ *
+ * Returns 0 on success, 1 on failure and -1 once the replayed trace
+ *  has run out.
+ */
+static int next_customer(struct sim_day *sim, struct addict **cur,
+        unsigned long *due)
+{
+    struct trace_record rec;
+    struct trace *replay = sim->config.replay;
+    struct trace *record = sim->config.record;
+
+    if(replay) {
+        if(trace_read(replay, &rec))
+            return -1;
+        *cur = pipeline_addict(sim->pipeline, sim->day, rec.class,
+                rec.seed);
+        check_pr(!*cur, "Out of memory or bad trace class", fail);
+        (*cur)->type = rec.type;
+        (*cur)->order_time = rec.order_time;
+        (*cur)->order_cost = rec.order_cost;
+    } else {
+        rec.class = pipeline_pick_class(sim->pipeline, &sim->rng);
+        rec.seed = rng_next(&sim->rng) >> 32;
+        rec.due = arrivals_next(&sim->arrivals, &sim->rng);
+        *cur = pipeline_addict(sim->pipeline, sim->day, rec.class,
+                rec.seed);
+        check_pr(!*cur, "Out of memory", fail);
+        rec.type = (*cur)->type;
+        rec.order_time = (*cur)->order_time;
+        rec.order_cost = (*cur)->order_cost;
+        rec.reserved = 0;
+    }
+    *due = rec.due;
+
+    if(record && trace_write(record, &rec)) {
+        pool_free(&sim->day->addicts, *cur);
+        check_pr(1, "Cannot write trace", fail);
+    }
+    return 0;
+fail:
+    return 1;
+}
+
+/*
+ * Run the day, sending its customers through the store, and wait for
+ *  the last of them to leave. A day runs once.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int sim_day_run(struct sim_day *sim)
+{
+    struct workers *workers = NULL;
+    struct addict *cur;
+    stamp_t day_start;
+    unsigned long due;
+    unsigned int i;
+    int next, stuck = 0, ret = 1;
+    pthread_attr_t attr;
+    pthread_t *threads = NULL;
+
+    check_pr(sim->metrics && metrics_start(sim->metrics),
+            "Cannot publish metrics", out);
+    if(sim->config.mode == SIM_THREADS) {
+        threads = malloc(sim->config.customers * sizeof(pthread_t));
+        check_pr(!threads, "Out of memory", out);
+    }
+    if(sim->config.mode == SIM_WORKERS) {
+        workers = init_workers(sim->config.workers, sim->config.customers);
+        check_pr(!workers, "Failed to start workers", out);
+    }
+
+    /* Initialize the detachable attributes */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, THREAD_STACK_SIZE);
+
+    /* Spawn customers on schedule, until a replayed trace runs out */
+    arrivals_rewind(&sim->arrivals);
+    if(sim->config.replay)
+        trace_rewind(sim->config.replay);
+    day_start = timer_now();
+    for(i = 0; i < sim->config.customers; i++) {
+        next = next_customer(sim, &cur, &due);
+        if(next < 0)
+            break;
+        check(next, finish);
+        check_pr(send_addict(sim, cur, i, due, day_start, workers,
+                    &attr, threads ? &threads[i] : NULL),
+                "Out of memory", finish);
+    }
+    ret = 0;
+finish:
+    /* Simulated customers only move once the whole day has arrived */
+    if(sim->config.mode == SIM_FIBERS)
+        stuck = fiber_run();
+    if(sim->config.mode == SIM_DES)
+        stuck = des_run();
+    /*
+     * Wait until the work for the day is done. A simulation that failed
+     *  has stopped on this thread, and may have left customers behind
+     *  that will never leave, so there is nothing to wait for.
+     */
+    if(stuck)
+        ret = 1;
+    else
+        latch_wait(&sim->day->running);
+    if(workers)
+        destroy_workers(workers);
+    pthread_attr_destroy(&attr);
+    day_keep_servers(sim->day, sim->pipeline);
+out:
+    free(threads);
+    if(sim->metrics)
+        metrics_stop(sim->metrics);
+    return ret;
+}
+
+/*
+ * Tally up the day once it has run. The histograms in results belong
+ *  to the day, until it is destroyed.
+ */
+void sim_day_results(struct sim_day *sim, struct sim_results *results)
+{
+    struct day *day = sim->day;
+
+    results->profit = day_profit(day);
+    results->simple_count = day->simple_count.val;
+    results->complex_count = day->complex_count.val;
+    /* Simple times fill the list from the front, complex from the back */
+    results->simple_avg = 0;
+    if(day->simple_count.val > 0)
+        results->simple_avg = average_list(day->times,
+                day->simple_count.val);
+    results->complex_avg = 0;
+    if(day->complex_count.val > 0)
+        results->complex_avg = average_list(day->times + day->size -
+                day->complex_count.val, day->complex_count.val);
+    day_hists(day, &day->simple_hist, &day->complex_hist);
+    results->simple_hist = &day->simple_hist;
+    results->complex_hist = &day->complex_hist;
+    results->n_servers = day->n_servers;
+    results->servers = day->servers;
+}
+
+/*
+ * Free the day, which must not be running. Its traces stay open, and
+ *  its metrics segment stays behind for its readers.
+ */
+void sim_day_destroy(struct sim_day *sim)
+{
+    if(sim->metrics)
+        metrics_destroy(sim->metrics);
+    destroy_arrivals(&sim->arrivals);
+    destroy_pipeline(sim->pipeline);
+    destroy_day(sim->day);
+    free(sim);
+}
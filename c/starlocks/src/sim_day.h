@@ -0,0 +1,95 @@
+/*
+ * sim_day - A day at Starlocks, as a library.
+ *
+ * sim_day_create() sets up a day from a struct sim_config: the store
+ * is laid out, the arrival schedule read and every addict allocated.
+ * sim_day_run() then sends the day's customers through the store and
+ * returns once the last has left, and sim_day_results() tallies up
+ * what happened. Everything a day touches belongs to its struct
+ * sim_day (the customers find their struct day through their addict),
+ * so any number of days may be created and run at once, from any
+ * threads, as long as each day is run by one thread.
+ *
+ * A day given a metrics name publishes snapshots of itself to shared
+ * memory as it runs; see metrics.h.
+ *
+ * A day draws its customers from a generator of its own, seeded by
+ * its config. Days with the same seed draw the same customers unless
+ * they are given different streams, which never overlap.
+ *
+ * Days run in real time (SIM_THREADS, SIM_WORKERS) compete for the
+ * machine with every other day running then; days in virtual time
+ * (SIM_FIBERS, SIM_DES) run entirely on the thread that runs them.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _SIM_DAY_H_
+#define _SIM_DAY_H_
+
+#include "day.h"
+#include "pipeline.h"
+#include "arrivals.h"
+#include "trace.h"
+#include "rng.h"
+#include "metrics.h"
+
+/* How the customers are carried through the store */
+enum
+{
+    SIM_THREADS,                /* A thread per customer */
+    SIM_WORKERS,                /* A pool of worker threads */
+    SIM_FIBERS,                 /* Fibers, in virtual time */
+    SIM_DES                     /* Discrete-event simulation */
+};
+
+struct sim_config {
+    unsigned int customers;
+    unsigned int selfserve;     /* Store, when there is no layout */
+    unsigned int barista;
+    unsigned int cashier;
+    const char *layout;         /* Layout file, see pipeline.h, or NULL */
+    int mode;                   /* SIM_* */
+    int workers;                /* SIM_WORKERS pool, 0 for one per CPU */
+    int dispatch;               /* DISPATCH_* among alternative stages */
+    double mix;                 /* Share of simple orders, or -1 */
+    const char *arrivals;       /* See arrivals.h, NULL for a burst */
+    struct trace *replay;       /* Trace of the customers to send */
+    struct trace *record;       /* Trace to record the customers in */
+    uint64_t seed;              /* Seeds the day's random draws */
+    unsigned int stream;        /* Draw from the stream'th stream of seed */
+    const char *metrics;        /* Segment to publish to, or NULL */
+    int quiet;
+};
+
+#define SIM_CONFIG_INIT { .mode = SIM_THREADS, .dispatch = DISPATCH_FIXED, \
+    .mix = -1 }
+
+struct sim_results {
+    long profit;                /* In cents */
+    int simple_count;           /* Customers served, by order type */
+    int complex_count;
+    long simple_avg;            /* Average turnaround, in nsecs */
+    long complex_avg;
+    hist_t *simple_hist;        /* Turnaround, in nsecs */
+    hist_t *complex_hist;
+    int n_servers;
+    struct day_server *servers; /* Turnaround and stats per server */
+};
+
+struct sim_day {
+    struct sim_config config;
+    struct day *day;            /* What the customers tally up */
+    struct pipeline *pipeline;  /* The store */
+    struct arrivals arrivals;
+    rng_t rng;                  /* Draws the customers */
+    struct metrics_pub *metrics; /* Live metrics, or NULL */
+};
+
+struct sim_day *sim_day_create(const struct sim_config *);
+int sim_day_run(struct sim_day *);
+void sim_day_results(struct sim_day *, struct sim_results *);
+void sim_day_destroy(struct sim_day *);
+
+#endif /* _SIM_DAY_H_ */
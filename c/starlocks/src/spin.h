@@ -0,0 +1,75 @@
+/*
+ * Adaptive spin-then-park policy.
+ *
+ * A waiter spins with the CPU's pause hint for a bounded number of
+ * iterations before falling back to a sleeping wait. The bound is
+ * self-tuning in the style of glibc's adaptive mutexes: every wait
+ * pulls a running average towards the number of iterations it spun,
+ * and the next waiter may spin for twice that average. Short recent
+ * hold times therefore keep the limit low, while waits that keep
+ * outlasting it let it grow up to SPIN_MAX. Spinning is never enabled
+ * on a single CPU, where it could only delay the holder.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _SPIN_H_
+#define _SPIN_H_
+
+#include <unistd.h>
+
+/* Bounds on the number of pause iterations before parking */
+#ifndef SPIN_MIN
+#define SPIN_MIN        10
+#endif
+#ifndef SPIN_MAX
+#define SPIN_MAX        1000
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()     __builtin_ia32_pause()
+#else
+#define cpu_relax()     __asm__ __volatile__("" ::: "memory")
+#endif
+
+typedef struct spin {
+    int enabled;                    /* Spin before parking at all */
+    int spins;                      /* Running estimate of spin need */
+} spin_t;
+
+/* Static initializer (spinning disabled) */
+#define SPIN_INIT { 0, 0 }
+
+/* Dynamic initializer */
+static inline void spin_init(spin_t *spin, int enabled)
+{
+    spin->enabled = enabled && sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    spin->spins = 0;
+}
+
+/* Number of iterations the next waiter may spin for. */
+static inline int spin_limit(spin_t *spin)
+{
+    int limit;
+    if(!spin || !spin->enabled)
+        return 0;
+    limit = 2 * __atomic_load_n(&spin->spins, __ATOMIC_RELAXED) + SPIN_MIN;
+    return limit < SPIN_MAX ? limit : SPIN_MAX;
+}
+
+/* 
+ * Feed back the number of iterations a wait spun for (its limit if it
+ *  had to park). Updates race benignly between waiters.
+ */
+static inline void spin_update(spin_t *spin, int cnt)
+{
+    int spins;
+    if(!spin || !spin->enabled)
+        return;
+    spins = __atomic_load_n(&spin->spins, __ATOMIC_RELAXED);
+    spins += (cnt - spins) / 8;
+    __atomic_store_n(&spin->spins, spins, __ATOMIC_RELAXED);
+}
+
+#endif /* _SPIN_H_ */
@@ -1,6 +1,9 @@
 /* 
  * Global variables for starlocks 
  *
+ * Everything a day tallies up lives in its struct day (see day.h);
+ * only settings shared by every day in the process are global.
+ *
  * James Sullivan <sullivan.james.f@gmail.com>
  * 10095183
  */
@@ -8,14 +11,7 @@
 #ifndef _STARLOCKS_H_
 #define _STARLOCKS_H_
 
-#include "count.h"
-
-extern count_t gl_profit;
-extern count_t running_threads;
-extern count_t simple_count;
-extern count_t complex_count;
-extern long *simple_times;
-extern long *complex_times;
+extern int adaptive_spin;
+extern int batch_admit;
 
 #endif /* _STARLOCKS_H */
-
@@ -0,0 +1,145 @@
+/*
+ * starlocks_watch - Follow a running day's live metrics.
+ *
+ * Polls the shared memory segment that ./starlocks -M metrics_name
+ * publishes to (see metrics.h), and prints a line for every new
+ * snapshot: seconds into the day, customers gone out of those due,
+ * customers in the store, profit so far, the p50 and p99 turnaround
+ * of every customer gone, and how many are at each server. Reading
+ * never holds up the day, so the poll interval may be as short as
+ * wanted; the day itself publishes every METRICS_INTERVAL_US, and its
+ * percentiles every METRICS_HIST_EVERY snapshots.
+ *
+ * Waits for the segment if there is none yet, or if it was left behind
+ * by a process that has since exited, and exits once the day is done. With -x, a day whose p99 turnaround passes the given
+ * number of msecs is sent SIGTERM, so that bad configurations of a
+ * long run can be abandoned early.
+ *
+ * Usage: ./starlocks_watch metrics_name [-i msecs] [-x p99_msecs]
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include "metrics.h"
+#include "check.h"
+
+/* Sleep for the given number of msecs. */
+static void nap(double msecs)
+{
+    struct timespec ts;
+    ts.tv_sec = msecs / 1000;
+    ts.tv_nsec = (msecs - ts.tv_sec * 1000) * NSEC_PER_MSEC;
+    while(nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+/* Returns 1 if the process whose day the segment holds has exited. */
+static int stale(const struct metrics *seg)
+{
+    return kill(seg->pid, 0) && errno == ESRCH;
+}
+
+/* Print the header line for the servers of the segment. */
+static void print_header(struct metrics *snap)
+{
+    int i;
+    printf("Secs\tGone\tIn\tProfit\tp50_ms\tp99_ms");
+    for(i = 0; i < snap->n_servers; i++)
+        printf("\t%s", snap->servers[i].name);
+    printf("\n");
+}
+
+/*
+ * Print a line for the snapshot.
+ *
+ * Returns the p99 turnaround of every customer gone, in nsecs.
+ */
+static unsigned long print_snapshot(struct metrics *snap)
+{
+    int i;
+    unsigned long p99;
+    static hist_t all;
+
+    all = snap->simple_hist;
+    hist_merge(&all, &snap->complex_hist);
+    p99 = hist_percentile(&all, 0.99);
+    printf("%.3f\t%lu/%u\t%lu\t%ld.%02ld\t%.3f\t%.3f",
+            (double)timer_ns(snap->started, snap->stamp) / NSEC_PER_SEC,
+            snap->finished, snap->customers,
+            snap->spawned - snap->finished,
+            snap->profit / 100, snap->profit % 100,
+            (double)hist_percentile(&all, 0.5) / NSEC_PER_MSEC,
+            (double)p99 / NSEC_PER_MSEC);
+    for(i = 0; i < snap->n_servers; i++)
+        printf("\t%d", snap->servers[i].present);
+    printf("\n");
+    fflush(stdout);
+    return p99;
+}
+
+int main(int argc, char **argv)
+{
+    int opt, waiting = 0;
+    double interval = 100, limit = 0;
+    unsigned long seen = 0;
+    const struct metrics *seg;
+    static struct metrics snap;
+
+    while((opt = getopt(argc, argv, "i:x:")) != -1) {
+        switch(opt) {
+            case 'i':
+                interval = atof(optarg);
+                check_pr(interval <= 0, "Need a poll interval", usage);
+                break;
+            case 'x':
+                limit = atof(optarg);
+                check_pr(limit <= 0, "Need a p99 limit", usage);
+                break;
+            default:
+                goto usage;
+        }
+    }
+    check(optind != argc - 1, usage);
+
+    /* A segment outlives its day, so skip one whose process is gone */
+    while(!(seg = metrics_open(argv[optind])) || stale(seg)) {
+        if(seg)
+            metrics_close(seg);
+        if(!waiting++)
+            fprintf(stderr, "Waiting for a day at /dev/shm/%s\n",
+                    argv[optind]);
+        nap(interval);
+    }
+    do {
+        if(metrics_read(seg, &snap) || snap.snapshots == seen) {
+            check_pr(stale(seg), "The day died", close);
+            nap(interval);
+            continue;
+        }
+        if(!seen)
+            print_header(&snap);
+        seen = snap.snapshots;
+        if(print_snapshot(&snap) > limit * NSEC_PER_MSEC && limit > 0 &&
+                !snap.done) {
+            printf("p99 over %.3f ms, stopping the day\n", limit);
+            kill(seg->pid, SIGTERM);
+            metrics_close(seg);
+            return 2;
+        }
+        if(!snap.done)
+            nap(interval);
+    } while(!snap.done);
+    metrics_close(seg);
+    return 0;
+close:
+    metrics_close(seg);
+    return 1;
+usage:
+    printf("Usage: %s metrics_name [-i msecs] [-x p99_msecs]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,411 @@
+/*
+ * sweep - Many days at Starlocks, run side by side in one process.
+ *  See sweep.h.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "sweep.h"
+#include "sim_day.h"
+#include "timer.h"
+#include "check.h"
+
+/* A store configuration of the sweep */
+struct sweep_config {
+    unsigned int selfserve;
+    unsigned int barista;
+    unsigned int cashier;
+    int shared;                 /* Another has the same store type */
+};
+
+/* One trial day of a configuration, and what came of it */
+struct sweep_day {
+    int config;
+    unsigned int customers;
+    double simple;              /* Average turnaround, in msecs */
+    double complex;
+};
+
+/* The days of a sweep, handed out to its threads in turn */
+struct sweep_work {
+    struct sweep *sweep;
+    struct sweep_config *configs;
+    struct sweep_day *days;
+    int n_days;
+    int next;                   /* Next day to run */
+    int failed;
+};
+
+static struct option sweep_opts[] = {
+    { "trials", required_argument,  NULL,   't' },
+    { "jobs",   required_argument,  NULL,   'j' },
+    { "output", required_argument,  NULL,   'o' },
+    { "dispatch", required_argument, NULL,  'D' },
+    { "arrivals", required_argument, NULL,  'A' },
+    { "mix",    required_argument,  NULL,   'm' },
+    { "seed",   required_argument,  NULL,   'S' },
+    { NULL,     0,              NULL,   0 }
+};
+
+/* Add value to the range, keeping it sorted. Returns 0 on success. */
+static int range_add(struct sweep_range *range, unsigned int value)
+{
+    int i, at;
+
+    for(at = 0; at < range->n && range->values[at] < value; at++);
+    if(at < range->n && range->values[at] == value)
+        return 0;
+    if(range->n == SWEEP_VALUES)
+        return 1;
+    for(i = range->n; i > at; i--)
+        range->values[i] = range->values[i - 1];
+    range->values[at] = value;
+    range->n++;
+    return 0;
+}
+
+/*
+ * Read the values of a parameter from spec, as described in sweep.h,
+ *  in increasing order and without repeats.
+ *
+ * Returns 0 on success and 1 on a malformed spec or too many values.
+ */
+int sweep_range(struct sweep_range *range, const char *spec)
+{
+    unsigned int lo, hi;
+    int len;
+
+    range->n = 0;
+    while(*spec) {
+        if(sscanf(spec, "%u-%u%n", &lo, &hi, &len) == 2) {
+            check(hi < lo, fail);
+        } else {
+            check(sscanf(spec, "%u%n", &lo, &len) != 1, fail);
+            hi = lo;
+        }
+        for(; lo <= hi; lo++)
+            check(range_add(range, lo), fail);
+        spec += len;
+        if(*spec == ',')
+            spec++;
+        else
+            check(*spec, fail);
+    }
+    return range->n == 0;
+fail:
+    return 1;
+}
+
+/*
+ * Run one trial day as a discrete-event simulation on the calling
+ *  thread, and record the average turnaround of each order type. The
+ *  day draws from the stream'th stream of the sweep's seed, so its
+ *  results do not depend on which thread runs it or when.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+static int sweep_day(struct sweep *sweep, struct sweep_config *store,
+        struct sweep_day *result, unsigned int stream)
+{
+    int ret = 1;
+    struct sim_day *sim;
+    struct sim_results results;
+    struct sim_config config = SIM_CONFIG_INIT;
+
+    config.customers = result->customers;
+    config.selfserve = store->selfserve;
+    config.barista = store->barista;
+    config.cashier = store->cashier;
+    config.mode = SIM_DES;
+    config.dispatch = sweep->dispatch;
+    config.mix = sweep->mix;
+    config.arrivals = sweep->arrivals_spec;
+    config.seed = sweep->seed;
+    config.stream = stream;
+    config.quiet = 1;
+
+    sim = sim_day_create(&config);
+    check(!sim, out);
+    check(sim_day_run(sim), destroy);
+    sim_day_results(sim, &results);
+    result->simple = hist_mean(results.simple_hist) / NSEC_PER_MSEC;
+    result->complex = hist_mean(results.complex_hist) / NSEC_PER_MSEC;
+    ret = 0;
+destroy:
+    sim_day_destroy(sim);
+out:
+    return ret;
+}
+
+/* Thread body: run days of the sweep until there are none left. */
+static void *sweep_worker(void *arg)
+{
+    struct sweep_work *work = arg;
+    struct sweep_day *result;
+    int i;
+
+    while((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED))
+            < work->n_days) {
+        result = &work->days[i];
+        if(sweep_day(work->sweep, &work->configs[result->config], result,
+                    i))
+            __atomic_store_n(&work->failed, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/*
+ * Fill configs with every store configuration of the sweep. Stores
+ *  without self services take the first number of cashiers only, and
+ *  those with self services but no cashiers or any store without
+ *  baristas are left out.
+ *
+ * Returns the number of configurations.
+ */
+static int sweep_configs(struct sweep *sweep, struct sweep_config *configs)
+{
+    int s, b, c, i, j, n = 0;
+    struct sweep_config *config;
+
+    for(s = 0; s < sweep->selfserve.n; s++)
+        for(b = 0; b < sweep->barista.n; b++)
+            for(c = 0; c < sweep->cashier.n; c++) {
+                config = &configs[n];
+                config->selfserve = sweep->selfserve.values[s];
+                config->barista = sweep->barista.values[b];
+                config->cashier = config->selfserve ?
+                    sweep->cashier.values[c] : 0;
+                config->shared = 0;
+                if(!config->barista || (config->selfserve &&
+                            !config->cashier))
+                    continue;
+                if(!config->selfserve && c)
+                    continue;
+                n++;
+            }
+
+    /* Tell apart configurations of the same store type */
+    for(i = 0; i < n; i++)
+        for(j = 0; j < n; j++)
+            if(i != j && !configs[i].selfserve == !configs[j].selfserve)
+                configs[i].shared = 1;
+    return n;
+}
+
+/* Write one results.dat line: the statistics of a type's n averages. */
+static void sweep_row(FILE *out, const char *order,
+        struct sweep_config *config, unsigned int customers,
+        double *avgs, int n)
+{
+    int i;
+    double mean = 0, var = 0, max = avgs[0], min = avgs[0];
+
+    for(i = 0; i < n; i++) {
+        mean += avgs[i];
+        max = avgs[i] > max ? avgs[i] : max;
+        min = avgs[i] < min ? avgs[i] : min;
+    }
+    mean /= n;
+    for(i = 0; i < n; i++)
+        var += (avgs[i] - mean) * (avgs[i] - mean);
+    /* The sample standard deviation, as R's sd() */
+    var = n > 1 ? var / (n - 1) : 0;
+
+    fprintf(out, "%s+%s", order,
+            config->selfserve ? "Starlocks" : "Classic");
+    if(config->shared && config->selfserve)
+        fprintf(out, "-s%u-b%u-c%u", config->selfserve, config->barista,
+                config->cashier);
+    else if(config->shared)
+        fprintf(out, "-b%u", config->barista);
+    fprintf(out, "\t%u\t%f\t%f\t%f\t%f\n", customers, mean, sqrt(var),
+            max, min);
+}
+
+/*
+ * Run every day of the sweep and write the results, as the lines of a
+ *  results.dat by increasing number of customers.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int sweep_run(struct sweep *sweep, FILE *results)
+{
+    int i, j, k, n_configs, jobs, ret = 1;
+    unsigned int customers;
+    double *simple, *complex;
+    pthread_t *threads;
+    struct sweep_day *day;
+    struct sweep_work work = { sweep, NULL, NULL, 0, 0, 0 };
+
+    work.configs = malloc(sweep->selfserve.n * sweep->barista.n *
+            sweep->cashier.n * sizeof(struct sweep_config));
+    check(!work.configs, out);
+    n_configs = sweep_configs(sweep, work.configs);
+    check_pr(!n_configs, "No store to sweep", free_configs);
+
+    /* Days by customers, then configuration, then trial */
+    work.n_days = sweep->customers.n * n_configs * sweep->trials;
+    work.days = malloc(work.n_days * sizeof(struct sweep_day));
+    check(!work.days, free_configs);
+    for(day = work.days, i = 0; i < sweep->customers.n; i++)
+        for(j = 0; j < n_configs; j++)
+            for(k = 0; k < sweep->trials; k++, day++) {
+                day->config = j;
+                day->customers = sweep->customers.values[i];
+            }
+
+    jobs = sweep->jobs ? sweep->jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if(jobs > work.n_days)
+        jobs = work.n_days;
+    threads = malloc(jobs * sizeof(pthread_t));
+    check(!threads, free_days);
+    /* Any threads that did start get through every day between them */
+    for(i = 0; i < jobs; i++)
+        if(pthread_create(&threads[i], NULL, sweep_worker, &work))
+            break;
+    check_pr(!i, "Failed to start sweep threads", free_threads);
+    for(j = 0; j < i; j++)
+        pthread_join(threads[j], NULL);
+    check_pr(work.failed, "Sweep Aborted (Out of resources).",
+            free_threads);
+
+    simple = malloc(2 * sweep->trials * sizeof(double));
+    check(!simple, free_threads);
+    complex = simple + sweep->trials;
+    fprintf(results, "Type\tCustomers\tAverage\tStdDev\tMax\tMin\n");
+    for(day = work.days; day < work.days + work.n_days; ) {
+        customers = day->customers;
+        j = day->config;
+        for(k = 0; k < sweep->trials; k++, day++) {
+            simple[k] = day->simple;
+            complex[k] = day->complex;
+        }
+        sweep_row(results, "Simple", &work.configs[j], customers, simple,
+                sweep->trials);
+        sweep_row(results, "Complex", &work.configs[j], customers, complex,
+                sweep->trials);
+    }
+    free(simple);
+    ret = 0;
+free_threads:
+    free(threads);
+free_days:
+    free(work.days);
+free_configs:
+    free(work.configs);
+out:
+    return ret;
+}
+
+static inline void print_sweep_usage(char *name)
+{
+    printf("Usage: %s sweep customers [-s selfserves] [-b baristas] "
+            "[-c cashiers] [-t trials] [-j jobs] [-o results_file] "
+            "[-D fixed|jsq|p2c|steal] [-A arrivals] [-m simple_share] "
+            "[-S seed]\n"
+            "  customers, selfserves, baristas and cashiers are lists "
+            "such as 10,50,100-102\n", name);
+}
+
+/*
+ * Command line of ./starlocks sweep, with argv[0] being "sweep".
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int sweep_main(int argc, char **argv)
+{
+    int opt, ret = 1;
+    FILE *results = stdout;
+    struct arrivals arrivals;
+    struct sweep sweep = {
+        .trials = 10, .jobs = 0, .mix = -1,
+        .dispatch = DISPATCH_FIXED, .arrivals_spec = NULL,
+        .seed = time(NULL)
+    };
+
+    sweep_range(&sweep.selfserve, "0");
+    sweep_range(&sweep.barista, "1");
+    sweep_range(&sweep.cashier, "1");
+    if(argc < 2) {
+        print_sweep_usage(program_invocation_name);
+        goto out;
+    }
+    check_pr(sweep_range(&sweep.customers, argv[1]),
+            "Bad list of customers", out);
+
+    while((opt = getopt_long(argc, argv, "s:b:c:t:j:o:D:A:m:S:",
+                    sweep_opts, NULL)) != -1) {
+        switch(opt) {
+            case 's':
+                check_pr(sweep_range(&sweep.selfserve, optarg),
+                        "Bad list of self services", close);
+                break;
+            case 'b':
+                check_pr(sweep_range(&sweep.barista, optarg),
+                        "Bad list of baristas", close);
+                break;
+            case 'c':
+                check_pr(sweep_range(&sweep.cashier, optarg),
+                        "Bad list of cashiers", close);
+                break;
+            case 't':
+                sweep.trials = atoi(optarg);
+                check_pr(sweep.trials < 1, "Need at least one trial",
+                        close);
+                break;
+            case 'j':
+                sweep.jobs = atoi(optarg);
+                if(sweep.jobs < 0)
+                    sweep.jobs = 0;
+                break;
+            case 'o':
+                if(results != stdout)
+                    fclose(results);
+                results = fopen(optarg, "w");
+                check_pr(!results, "Cannot open results file", out);
+                break;
+            case 'D':
+                sweep.dispatch = dispatch_policy(optarg);
+                check_pr(sweep.dispatch < 0, "Unknown dispatch policy",
+                        close);
+                break;
+            case 'A':
+                sweep.arrivals_spec = optarg;
+                break;
+            case 'm':
+                sweep.mix = atof(optarg);
+                check_pr(sweep.mix < 0 || sweep.mix > 1,
+                        "The mix must be between 0 and 1", close);
+                break;
+            case 'S':
+                sweep.seed = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                print_sweep_usage(program_invocation_name);
+                goto close;
+        }
+    }
+    check_pr(sweep.customers.values[0] == 0, "Need at least one customer",
+            close);
+    /* Check the schedule once, rather than in every day */
+    check_pr(init_arrivals(&arrivals, sweep.arrivals_spec),
+            "Bad arrival schedule", close);
+    destroy_arrivals(&arrivals);
+
+    ret = sweep_run(&sweep, results);
+close:
+    if(results != stdout && fclose(results))
+        ret = 1;
+out:
+    return ret;
+}
@@ -0,0 +1,54 @@
+/*
+ * sweep - Many days at Starlocks, run side by side in one process.
+ *
+ * A sweep runs a number of trial days for every combination of the
+ * numbers of customers, self services, baristas and cashiers asked
+ * for, and reports each customer type's turnaround in every store
+ * configuration as the mean, standard deviation, maximum and minimum
+ * over the trials of the day's average turnaround, in milliseconds.
+ * These are the columns of the results.dat that stat/plot.R reads.
+ *
+ * Every day is a discrete-event simulation (see des.h) with a struct
+ * day of its own, so days share nothing and are spread over a pool of
+ * threads, one per CPU by default. Stores without self services are
+ * laid out the classic way and ignore the number of cashiers.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SWEEP_VALUES    32      /* Values per swept parameter */
+
+/*
+ * Values of a parameter, written as a comma separated list of numbers
+ * and lo-hi ranges, such as "10,50,100-102".
+ */
+struct sweep_range {
+    int n;
+    unsigned int values[SWEEP_VALUES];
+};
+
+struct sweep {
+    struct sweep_range customers;
+    struct sweep_range selfserve;
+    struct sweep_range barista;
+    struct sweep_range cashier;
+    int trials;                 /* Days per configuration */
+    int jobs;                   /* Days run at once, 0 for one per CPU */
+    double mix;                 /* Share of simple orders, or -1 */
+    int dispatch;               /* DISPATCH_* among alternative stages */
+    const char *arrivals_spec;  /* See arrivals.h, NULL for a burst */
+    uint64_t seed;              /* Every day draws from a stream of it */
+};
+
+int sweep_range(struct sweep_range *, const char *spec);
+int sweep_run(struct sweep *, FILE *results);
+int sweep_main(int argc, char **argv);
+
+#endif /* _SWEEP_H_ */
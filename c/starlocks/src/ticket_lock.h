@@ -0,0 +1,79 @@
+/*
+ * Ticket lock with futex sleeping.
+ *
+ * A thread takes a ticket with one atomic increment and waits until
+ * the "now serving" word reaches it. Unlocking advances that word and
+ * issues a single FUTEX_WAKE. Waiters sleep on the serving word with a
+ * bitset derived from their ticket, so a handoff only wakes the next
+ * ticket holder (and any that alias it modulo 32) instead of the whole
+ * line. Waiters may spin on the serving word under an adaptive spin
+ * policy before they sleep.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _TICKET_LOCK_H_
+#define _TICKET_LOCK_H_
+
+#include <limits.h>
+#include "futex.h"
+#include "spin.h"
+
+typedef struct ticket_lock {
+    int next;                       /* Next ticket to hand out */
+    int serving;                    /* Ticket now served, futex word */
+} ticket_lock_t;
+
+/* Static initializer */
+#define TICKET_LOCK_INIT { 0, 0 }
+
+/* Dynamic initializer */
+static inline void ticket_lock_init(ticket_lock_t *lock)
+{
+    lock->next = 0;
+    lock->serving = 0;
+}
+
+/* The futex bit that the holder of the given ticket waits on */
+#define ticket_bit(ticket) (1 << ((unsigned int)(ticket) & 31))
+
+/* 
+ * Take a ticket and block until it is being served, spinning first
+ *  under the given policy (which may be NULL).
+ */
+static inline void ticket_lock(ticket_lock_t *lock, spin_t *spin)
+{
+    int cnt, limit, cur, me;
+
+    me = __atomic_fetch_add(&lock->next, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE) == me)
+        return;
+
+    limit = spin_limit(spin);
+    for(cnt = 0; cnt < limit; cnt++) {
+        if(__atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE) == me)
+            break;
+        cpu_relax();
+    }
+    spin_update(spin, cnt);
+
+    while((cur = __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE)) != me)
+        futex_wait_bitset(&lock->serving, cur, ticket_bit(me));
+}
+
+/* Serve the next ticket, waking its holder if anyone is waiting. */
+static inline void ticket_unlock(ticket_lock_t *lock)
+{
+    /*
+     * Ordered against the ticket grab so a new waiter is never missed.
+     *  Atomic adds wrap, as ticket grabs do, where a plain add to an int
+     *  would overflow.
+     */
+    int next = __atomic_add_fetch(&lock->serving, 1, __ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&lock->next, __ATOMIC_SEQ_CST) != next)
+        futex_wake_bitset(&lock->serving, INT_MAX, ticket_bit(next));
+}
+
+#endif /* _TICKET_LOCK_H_ */
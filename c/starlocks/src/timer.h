@@ -1,6 +1,12 @@
 /*
  * Static timer function definitions.
  *
+ * Times are nanosecond timestamps (stamp_t) on CLOCK_MONOTONIC, which
+ * never jumps when the wall clock is set, and which the vDSO reads
+ * without a system call on most machines. Simulated customers use the
+ * same units on the virtual clock, so one set of helpers serves both.
+ * timer_cost() measures what a timestamp costs on this machine.
+ *
  * James Sullivan <sullivan.james.f@gmail.com>
  * 10095183
  */
@@ -10,36 +16,63 @@
 
 #include <time.h>
 
+#define NSEC_PER_USEC   1000ul
+#define NSEC_PER_MSEC   1000000ul
+#define NSEC_PER_SEC    1000000000ul
+
+typedef unsigned long stamp_t;          /* Nanoseconds */
+
+/* Returns the current time on the monotonic clock */
+static inline stamp_t timer_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
 /* Return the difference in time between start and end in seconds */
-inline long timer_s(struct timeval *start, struct timeval *end)
+static inline long timer_s(stamp_t start, stamp_t end)
 {
-    long delta = end->tv_sec - start->tv_sec;
-    return delta;
+    return (end - start) / NSEC_PER_SEC;
 }
 
 /* Return the difference in time between start and end in millisecs */
-inline long timer_ms(struct timeval *start, struct timeval *end)
+static inline long timer_ms(stamp_t start, stamp_t end)
 {
-    long delta = ((end->tv_sec - start->tv_sec) * 1000000) 
-            + (end->tv_usec - start->tv_usec);
-    return delta / 1000000;
+    return (end - start) / NSEC_PER_MSEC;
 }
 
 /* Return the difference in time between start and end in microsecs */
-inline long timer_us(struct timeval *start, struct timeval *end)
+static inline long timer_us(stamp_t start, stamp_t end)
 {
-    long delta = ((end->tv_sec - start->tv_sec) * 1000000) 
-            + (end->tv_usec - start->tv_usec);
-    return delta / 1000;
+    return (end - start) / NSEC_PER_USEC;
 }
 
 /* Return the difference in time between start and end in nanosecs */
-inline long timer_ns(struct timeval *start, struct timeval *end)
+static inline long timer_ns(stamp_t start, stamp_t end)
 {
-    long delta = ((end->tv_sec - start->tv_sec) * 1000000) 
-            + (end->tv_usec - start->tv_usec);
-    return delta;
+    return end - start;
 }
 
-#endif /* _TIMER_H_ */
+/* Express a timestamp as a timespec, for clock_nanosleep() */
+static inline void timer_timespec(stamp_t stamp, struct timespec *ts)
+{
+    ts->tv_sec = stamp / NSEC_PER_SEC;
+    ts->tv_nsec = stamp % NSEC_PER_SEC;
+}
+
+/*
+ * Returns the average cost of a timestamp over n back-to-back ones, in
+ *  nanoseconds.
+ */
+static inline unsigned long timer_cost(unsigned int n)
+{
+    unsigned int i;
+    stamp_t start = timer_now(), end = start;
+
+    for(i = 0; i < n; i++)
+        end = timer_now();
+    return n ? timer_ns(start, end) / n : 0;
+}
 
+#endif /* _TIMER_H_ */
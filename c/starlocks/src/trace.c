@@ -0,0 +1,145 @@
+/*
+ * trace - Binary record of the customers of a day. See trace.h.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <stdlib.h>
+#include "trace.h"
+#include "check.h"
+
+/* Returns a new trace on file, or NULL if out of memory. */
+static struct trace *init_trace(FILE *file, int writing)
+{
+    struct trace *trace = malloc(sizeof(struct trace));
+    check(!trace, out);
+
+    trace->chunk = malloc(TRACE_CHUNK * sizeof(struct trace_record));
+    check(!trace->chunk, free_trace);
+    trace->file = file;
+    trace->writing = writing;
+    trace->next = 0;
+    trace->count = 0;
+    return trace;
+free_trace:
+    free(trace);
+out:
+    return NULL;
+}
+
+/*
+ * Open the trace at path for reading.
+ *
+ * Returns the trace, or NULL if it cannot be opened or is not a trace
+ *  this build can read.
+ */
+struct trace *trace_open(const char *path)
+{
+    struct trace *trace;
+    struct trace_header header;
+    FILE *file = fopen(path, "rb");
+    check(!file, out);
+
+    check(fread(&header, sizeof(header), 1, file) != 1, close);
+    check(header.magic != TRACE_MAGIC, close);
+    check(header.version != TRACE_VERSION, close);
+    check(header.record_size != sizeof(struct trace_record), close);
+    trace = init_trace(file, 0);
+    check(!trace, close);
+    return trace;
+close:
+    fclose(file);
+out:
+    return NULL;
+}
+
+/*
+ * Create a trace at path to write to, replacing any file there.
+ *
+ * Returns the trace, or NULL on failure.
+ */
+struct trace *trace_create(const char *path)
+{
+    struct trace *trace;
+    struct trace_header header = {
+        TRACE_MAGIC, TRACE_VERSION, sizeof(struct trace_record), 0
+    };
+    FILE *file = fopen(path, "wb");
+    check(!file, out);
+
+    check(fwrite(&header, sizeof(header), 1, file) != 1, close);
+    trace = init_trace(file, 1);
+    check(!trace, close);
+    return trace;
+close:
+    fclose(file);
+out:
+    return NULL;
+}
+
+/*
+ * Read the next record of the trace into record.
+ *
+ * Returns 0 on success, or 1 at the end of the trace.
+ */
+int trace_read(struct trace *trace, struct trace_record *record)
+{
+    if(trace->next == trace->count) {
+        trace->count = fread(trace->chunk, sizeof(struct trace_record),
+                TRACE_CHUNK, trace->file);
+        trace->next = 0;
+        if(!trace->count)
+            return 1;
+    }
+    *record = trace->chunk[trace->next++];
+    return 0;
+}
+
+/* Write out the records waiting in the chunk. Returns 0 on success. */
+static int trace_flush(struct trace *trace)
+{
+    unsigned int count = trace->count;
+
+    trace->count = 0;
+    return fwrite(trace->chunk, sizeof(struct trace_record), count,
+            trace->file) != count;
+}
+
+/*
+ * Append record to the trace.
+ *
+ * Returns 0 on success and 1 on failure.
+ */
+int trace_write(struct trace *trace, struct trace_record *record)
+{
+    trace->chunk[trace->count++] = *record;
+    if(trace->count < TRACE_CHUNK)
+        return 0;
+    return trace_flush(trace);
+}
+
+/* Go back to the first record of a trace being read. */
+void trace_rewind(struct trace *trace)
+{
+    fseek(trace->file, sizeof(struct trace_header), SEEK_SET);
+    trace->next = 0;
+    trace->count = 0;
+}
+
+/*
+ * Close the trace, writing out any records still waiting.
+ *
+ * Returns 0 on success and 1 if they could not all be written.
+ */
+int trace_close(struct trace *trace)
+{
+    int ret = 0;
+
+    if(trace->writing)
+        ret = trace_flush(trace);
+    ret |= fclose(trace->file) != 0;
+    free(trace->chunk);
+    free(trace);
+    return ret;
+}
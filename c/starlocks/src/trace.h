@@ -0,0 +1,66 @@
+/*
+ * trace - Binary record of the customers of a day.
+ *
+ * A trace file is a header followed by one fixed-size record per
+ * customer, in arrival order. Every field is stored in the byte order
+ * of the machine that wrote it; the header's magic number reads
+ * backwards on a machine of the other order, and such a trace is
+ * rejected.
+ *
+ * A record holds everything needed to recreate the customer: when they
+ * walk in, their order (with time and cost in the units of struct
+ * addict), the customer class of the store layout they belong to and
+ * the seed for their routes through it (see rng32_next() in rng.h).
+ * Replaying a recorded day in the same layout therefore sends the very
+ * same customers through it.
+ *
+ * Traces are read and written in chunks of TRACE_CHUNK records, so a
+ * day of any length streams through a fixed amount of memory.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC     0x52544c53      /* "SLTR" */
+#define TRACE_VERSION   2
+#define TRACE_CHUNK     4096            /* Records per read or write */
+
+struct trace_header {
+    uint32_t magic;                     /* TRACE_MAGIC */
+    uint32_t version;                   /* TRACE_VERSION */
+    uint32_t record_size;               /* sizeof(struct trace_record) */
+    uint32_t reserved;
+};
+
+struct trace_record {
+    uint64_t due;                       /* Arrival, nsecs into the day */
+    uint32_t order_time;                /* Service time, loop iterations */
+    uint32_t order_cost;                /* In cents */
+    uint32_t seed;                      /* Seed for the routes taken */
+    uint8_t type;                       /* ATYPE_* of the order */
+    uint8_t class;                      /* Customer class of the layout */
+    uint16_t reserved;
+};
+
+struct trace {
+    FILE *file;
+    int writing;                        /* Opened by trace_create() */
+    unsigned int next;                  /* Next record in the chunk */
+    unsigned int count;                 /* Records in the chunk */
+    struct trace_record *chunk;         /* Records read or to write */
+};
+
+struct trace *trace_open(const char *path);
+struct trace *trace_create(const char *path);
+int trace_read(struct trace *, struct trace_record *);
+int trace_write(struct trace *, struct trace_record *);
+void trace_rewind(struct trace *);
+int trace_close(struct trace *);
+
+#endif /* _TRACE_H_ */
@@ -0,0 +1,111 @@
+/*
+ * workers - Fixed pool of customer-serving threads.
+ *
+ * Each worker repeatedly removes an addict from the head of the pool's
+ * queue and runs get_coffee() for it, sleeping on the pending
+ * semaphore while the queue is empty. Queueing worker_exit tells a
+ * worker to stop. Customer timing still starts when the addict is
+ * created, so time spent waiting for a free worker counts towards
+ * turnaround just as thread start-up does in the thread-per-customer
+ * mode.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "workers.h"
+#include "check.h"
+
+/* Marker addict that shuts a worker down */
+static struct addict worker_exit;
+
+/* Body of every pool thread. */
+static void *worker(void *arg)
+{
+    struct workers *workers = arg;
+    struct addict *addict;
+
+    for(;;) {
+        sem_wait(&workers->pending);
+        while(!(addict = ring_remove_head(&workers->queue)))
+            sched_yield();  /* Added but not yet published */
+        if(addict == &worker_exit)
+            break;
+        get_coffee(addict);
+    }
+    return NULL;
+}
+
+/*
+ * Start a pool of n_threads workers (one per online CPU if zero), with
+ *  room to queue n_customers at once.
+ *
+ * Returns NULL on failure.
+ */
+struct workers *init_workers(int n_threads, unsigned int n_customers)
+{
+    int i;
+    struct workers *workers;
+
+    /* The queue's head and tail each sit on a cache line of their own */
+    check(posix_memalign((void **)&workers, CACHELINE_SIZE,
+                sizeof(struct workers)), fail);
+
+    if(n_threads <= 0)
+        n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n_threads <= 0)
+        n_threads = 1;
+    workers->n_threads = 0;
+
+    /* Leave room for the exit markers as well */
+    check(ring_init(&workers->queue, n_customers + n_threads), free_workers);
+    sem_init(&workers->pending, 0, 0);
+    workers->threads = malloc(n_threads * sizeof(pthread_t));
+    check(!workers->threads, free_queue);
+
+    for(i = 0; i < n_threads; i++) {
+        check(pthread_create(&workers->threads[i], NULL, worker, workers),
+                stop);
+        workers->n_threads++;
+    }
+    goto out;
+
+stop:
+    destroy_workers(workers);
+    workers = NULL;
+    goto out;
+free_queue:
+    ring_destroy(&workers->queue);
+free_workers:
+    free(workers);
+    workers = NULL;
+out:
+    return workers;
+fail:
+    return NULL;
+}
+
+/* Queue an addict for the next free worker. */
+void workers_submit(struct workers *workers, struct addict *addict)
+{
+    while(ring_add_tail(addict, &workers->queue))
+        sched_yield();
+    sem_post(&workers->pending);
+}
+
+/* Stop every worker once the queue drains, and release the pool. */
+void destroy_workers(struct workers *workers)
+{
+    int i;
+    for(i = 0; i < workers->n_threads; i++)
+        workers_submit(workers, &worker_exit);
+    for(i = 0; i < workers->n_threads; i++)
+        pthread_join(workers->threads[i], NULL);
+    sem_destroy(&workers->pending);
+    ring_destroy(&workers->queue);
+    free(workers->threads);
+    free(workers);
+}
@@ -0,0 +1,31 @@
+/*
+ * workers - Fixed pool of customer-serving threads.
+ *
+ * Instead of one thread per customer, a fixed number of worker threads
+ * take addicts off a shared lock-free queue and carry each one through
+ * its service points in turn.
+ *
+ * James Sullivan <sullivan.james.f@gmail.com>
+ * 10095183
+ */
+
+#ifndef _WORKERS_H_
+#define _WORKERS_H_
+
+#include <pthread.h>
+#include <semaphore.h>
+#include "addict.h"
+#include "ring.h"
+
+struct workers {
+    ring_t queue;                       /* Customers not yet picked up */
+    sem_t pending;                      /* Number of queued customers */
+    int n_threads;                      /* Size of the pool */
+    pthread_t *threads;                 /* Pool threads */
+};
+
+struct workers *init_workers(int n_threads, unsigned int n_customers);
+void workers_submit(struct workers *, struct addict *);
+void destroy_workers(struct workers *);
+
+#endif /* _WORKERS_H_ */